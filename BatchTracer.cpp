@@ -0,0 +1,35 @@
+#include "BatchTracer.h"
+
+
+BatchTracer::BatchTracer(RungeKuttaRayBending::Parameters const& aParameters, Eikonal const& aEikonal, uint32_t const aThreadCount)
+  : mPool(aThreadCount) {
+  for(uint32_t i = 0u; i < mPool.getThreadCount(); ++i) {
+    mSolvers.push_back(std::make_unique<RungeKuttaRayBending>(aParameters, aEikonal));
+  }
+}
+
+void BatchTracer::traceBatch(Request const * const aRequests, uint64_t const aCount, Outcome * const aOutcomes, Options const& aOptions) {
+  mPool.run(aCount, aOptions.mChunk, [this, aRequests, aOutcomes, &aOptions](uint32_t const aThread, uint64_t const aBegin, uint64_t const aEnd) {
+    auto &solver = *mSolvers[aThread];
+    RungeKuttaRayBending::StepSchedule schedule;
+    for(uint64_t i = aBegin; i < aEnd; ++i) {
+      auto const& request = aRequests[i];
+      auto &outcome = aOutcomes[i];
+      auto const hint = (aOptions.mStepHints && schedule.mCount > 0u ? &schedule : nullptr);
+      try {
+        outcome.mResult = solver.solve4x(request.mRay.mStart, request.mRay.mDirection, request.mX, aOptions.mMaxStep, hint);
+        outcome.mStatus = (outcome.mResult.mValid ? Status::cValid : Status::cInvalid);
+        if(outcome.mResult.mValid) {
+          schedule = outcome.mResult.mSchedule;
+        }
+        else {} // nothing to do
+      }
+      catch(std::exception &) {
+        SOLVER_STATISTICS_ADD(cExceptions, 1u);
+        outcome.mResult.mValid = false;
+        outcome.mResult.mStepCount = 0u;
+        outcome.mStatus = Status::cFailed;
+      }
+    }
+  });
+}
@@ -0,0 +1,57 @@
+#ifndef BATCHTRACER_H
+#define BATCHTRACER_H
+
+#include "RungeKuttaRayBending.h"
+#include "ThreadPool.h"
+#include <memory>
+#include <vector>
+
+
+// Traces many rays to planes x = const on a persistent thread pool, each thread with its own solver.
+// The Eikonal must outlive the tracer. Image traces the plain rows of its mirage with it, see Image::isBatchable.
+class BatchTracer final {
+public:
+  struct Request {
+    Ray    mRay;
+    double mX;      // the ray ends where it reaches this x
+  };
+
+  enum class Status : uint8_t {
+    cValid   = 0u,
+    cInvalid = 1u,  // went below the surface, to the sky or needed too many or too small steps
+    cFailed  = 2u   // the solver threw
+  };
+
+  struct Outcome {
+    Status                       mStatus;
+    RungeKuttaRayBending::Result mResult;  // mStepCount is valid also for cInvalid
+  };
+
+  struct Options {
+    uint32_t mMaxStep   = RungeKuttaRayBending::csMaxStep;
+    uint32_t mChunk     = 64u;    // requests taken by a thread at once
+    bool     mStepHints = false;  // each request of a chunk gets the step sizes of the previous valid one, see Image
+  };
+
+private:
+  ThreadPool                                         mPool;
+  std::vector<std::unique_ptr<RungeKuttaRayBending>> mSolvers;  // one for each thread
+
+public:
+  // aThreadCount 0 means all CPUs.
+  BatchTracer(RungeKuttaRayBending::Parameters const& aParameters, Eikonal const& aEikonal, uint32_t const aThreadCount);
+
+  uint32_t getThreadCount() const { return mPool.getThreadCount(); }
+
+  // aOutcomes must have space for aCount items. The outcomes depend only on the requests and aOptions,
+  // not on the thread count, because the step hints are reset at each chunk.
+  void traceBatch(Request const * const aRequests, uint64_t const aCount, Outcome * const aOutcomes, Options const& aOptions);
+
+  // Resizes aOutcomes to the size of aRequests.
+  void traceBatch(std::vector<Request> const& aRequests, std::vector<Outcome> &aOutcomes, Options const& aOptions) {
+    aOutcomes.resize(aRequests.size());
+    traceBatch(aRequests.data(), aRequests.size(), aOutcomes.data(), aOptions);
+  }
+};
+
+#endif // BATCHTRACER_H
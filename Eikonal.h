@@ -6,6 +6,7 @@
 #include <cmath>
 #include <array>
 #include <cstdint>
+#include <type_traits>
 
 
 // These calculations do not take relative humidity in account, since it has less, than 0.5% the effect on air refractive index as temperature and pressure.
@@ -97,18 +98,22 @@ public:
   EarthForm getEarthForm()   const { return mEarthForm; }
   double    getEarthRadius() const { return mEarthRadius; }
 
+  // Evaluated in tReal arithmetic, while the variables stay double for GSL. For round Earth in double the origin
+  // is in the Earth center. In float it is on the surface below the start and the center is at (0, -radius, 0),
+  // because float can't resolve meters on the Earth radius.
+  template <typename tReal = Real>
   int differentials(double, const double aY[], double aDydt[]) const {
     int result;
-    double n    = getRefract(aY[1]);
-    double v    = csC / n;
-    double elevation;
-    std::array<double, 3u> zenith;
+    tReal n    = getRefract(static_cast<tReal>(aY[1]));
+    tReal v    = static_cast<tReal>(csC) / n;
+    tReal elevation;
+    std::array<tReal, 3u> zenith;
     if(mEarthForm == EarthForm::cFlat) {
       elevation = aY[1];
       zenith[0] = zenith[2] = 0.0;
       zenith[1] = 1.0;
     }
-    else {
+    else if constexpr(std::is_same_v<tReal, double>) {
       double fromCenter = std::sqrt(aY[0] * aY[0] + aY[1] * aY[1] + aY[2] * aY[2]);
       elevation = fromCenter - mEarthRadius;
       if(elevation > 0.0) {
@@ -118,12 +123,26 @@ public:
       }
       else {} // nothing to do
     }
+    else {
+      tReal x = aY[0];
+      tReal y = aY[1];
+      tReal z = aY[2];
+      tReal radius = mEarthRadius;
+      tReal fromCenter = std::sqrt(x * x + (y + radius) * (y + radius) + z * z);
+      elevation = (x * x + z * z + y * (y + 2.0f * radius)) / (fromCenter + radius);   // fromCenter - radius without cancellation
+      if(elevation > 0.0f) {
+        zenith[0] = x / fromCenter;
+        zenith[1] = (y + radius) / fromCenter;
+        zenith[2] = z / fromCenter;
+      }
+      else {} // nothing to do
+    }
     if(elevation > 0.0) {
       result = GSL_SUCCESS;
-      aDydt[0] = v * aY[3];
-      aDydt[1] = v * aY[4];
-      aDydt[2] = v * aY[5];
-      double u = getRefractDiff(elevation) / csC;
+      aDydt[0] = v * static_cast<tReal>(aY[3]);
+      aDydt[1] = v * static_cast<tReal>(aY[4]);
+      aDydt[2] = v * static_cast<tReal>(aY[5]);
+      tReal u = getRefractDiff(elevation) / static_cast<tReal>(csC);
       aDydt[3] = zenith[0] * u;
       aDydt[4] = zenith[1] * u;
       aDydt[5] = zenith[2] * u;
@@ -161,7 +180,8 @@ public:
   }
 
 public:
-  double getRefract(double const aH) const {
+  template <typename tReal = double>
+  tReal getRefract(tReal const aH) const {
     return mModel == Model::cConventional ? getConventionalRefract(aH) :
           (mModel == Model::cPorous ? getPorousRefract(aH) : getWaterRefract(aH));
   }
@@ -171,7 +191,8 @@ public:
           (mModel == Model::cPorous ? getPorousSlowness(aH) : getWaterSlowness(aH));
   }
 
-  double getRefractDiff(double const aH) const {
+  template <typename tReal = double>
+  tReal getRefractDiff(tReal const aH) const {
     return mModel == Model::cConventional ? getConventionalRefractDiff(aH) :
           (mModel == Model::cPorous ? getPorousRefractDiff(aH) : getWaterRefractDiff(aH));
   }
@@ -182,18 +203,22 @@ public:
   }
 
 private:
-  double getConventionalRefract(double const aH) const {
-    auto celsius = mTempAmbient + 0.018 + 6.37 * std::exp(-aH * 10.08);
-    return 1.0 + 7.86e-4 * 101 / (celsius + 273.15);
+  template <typename tReal>
+  tReal getConventionalRefract(tReal const aH) const {
+    using R = tReal;
+    auto celsius = R(mTempAmbient) + R(0.018) + R(6.37) * std::exp(-aH * R(10.08));
+    return R(1.0) + R(7.86e-4) * R(101) / (celsius + R(273.15));
   }
 
   double getConventionalSlowness(double const aH) const {
     return getConventionalRefract(aH) / csC;
   }
 
-  double getConventionalRefractDiff(double const aH) const {
-    auto t = mTempAmbient + 6.37 * std::exp(-10.08 * aH) + 273.168;
-    return 5.09734 * std::exp(-10.08 * aH) / t / t;
+  template <typename tReal>
+  tReal getConventionalRefractDiff(tReal const aH) const {
+    using R = tReal;
+    auto t = R(mTempAmbient) + R(6.37) * std::exp(R(-10.08) * aH) + R(273.168);
+    return R(5.09734) * std::exp(R(-10.08) * aH) / t / t;
   }
 
   double getConventionalRefractDiff2(double const aH) const {
@@ -202,18 +227,22 @@ private:
                              - (647.233 * std::exp(-10.08 * aH)));
   }
 
-  double getPorousRefract(double const aH) const {
-    auto celsius = mTempAmbient + (-66.8 + 1.9 * mTempAmbient) * (0.002 + 0.994 * std::exp(-aH * 8.35));
-    return 1.0 + 7.86e-4 * 101 / (celsius + 273.15);
+  template <typename tReal>
+  tReal getPorousRefract(tReal const aH) const {
+    using R = tReal;
+    auto celsius = R(mTempAmbient) + (R(-66.8) + R(1.9) * R(mTempAmbient)) * (R(0.002) + R(0.994) * std::exp(-aH * R(8.35)));
+    return R(1.0) + R(7.86e-4) * R(101) / (celsius + R(273.15));
   }
 
   double getPorousSlowness(double const aH) const {
     return getPorousRefract(aH) / csC;
   }
 
-  double getPorousRefractDiff(double const aH) const {
-    auto t = (1.9 * mTempAmbient - 66.8) * (0.002 + 0.994 * std::exp(-8.35 * aH)) + mTempAmbient + 273.15;
-    return 0.658896 * (1.9 * mTempAmbient - 66.8) * std::exp(-8.35 * aH) / t / t;
+  template <typename tReal>
+  tReal getPorousRefractDiff(tReal const aH) const {
+    using R = tReal;
+    auto t = (R(1.9) * R(mTempAmbient) - R(66.8)) * (R(0.002) + R(0.994) * std::exp(R(-8.35) * aH)) + R(mTempAmbient) + R(273.15);
+    return R(0.658896) * (R(1.9) * R(mTempAmbient) - R(66.8)) * std::exp(R(-8.35) * aH) / t / t;
   }
 
   double getPorousRefractDiff2(double const aH) const {
@@ -223,18 +252,22 @@ private:
                                  - (69.3042 * std::exp(-8.35 * aH)));
   }
 
-  double getWaterRefract(double const aH) const {
-    auto celsius = mTempAmbient + (mTempBase - mTempAmbient)*(0.011 + 1.05 * std::exp(-20.1 * aH));
-    return 1.0 + 7.86e-4 * 101 / (celsius + 273.15);
+  template <typename tReal>
+  tReal getWaterRefract(tReal const aH) const {
+    using R = tReal;
+    auto celsius = R(mTempAmbient) + R(mTempBase - mTempAmbient)*(R(0.011) + R(1.05) * std::exp(R(-20.1) * aH));
+    return R(1.0) + R(7.86e-4) * R(101) / (celsius + R(273.15));
   }
 
   double getWaterSlowness(double const aH) const {
     return getWaterRefract(aH) / csC;
   }
 
-  double getWaterRefractDiff(double const aH) const {
-    auto t = (mTempBase - mTempAmbient) * (0.011 + 1.05 * std::exp(-20.1 * aH)) + mTempAmbient + 273.15;
-    return 1.67544 * std::exp(-20.1 * aH) * (mTempBase - mTempAmbient) / t / t;
+  template <typename tReal>
+  tReal getWaterRefractDiff(tReal const aH) const {
+    using R = tReal;
+    auto t = R(mTempBase - mTempAmbient) * (R(0.011) + R(1.05) * std::exp(R(-20.1) * aH)) + R(mTempAmbient) + R(273.15);
+    return R(1.67544) * std::exp(R(-20.1) * aH) * R(mTempBase - mTempAmbient) / t / t;
   }
 
   double getWaterRefractDiff2(double const aH) const {
@@ -4,9 +4,13 @@
 #include <gsl/gsl_errno.h>
 #include <gsl/gsl_matrix.h>
 #include <gsl/gsl_odeiv2.h>
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <stdexcept>
-#include <functional>
+#include <type_traits>
 
 
 enum class StepperType : uint8_t {
@@ -18,23 +22,98 @@ enum class StepperType : uint8_t {
   cBulirschStoerBaderDeuflhard = 5u
 };
 
-template <typename tOdeDefinition>
+inline char const* getStepperName(StepperType const aStepper) {
+  return aStepper == StepperType::cRungeKutta23 ? "RungeKutta23" :
+        (aStepper == StepperType::cRungeKuttaClass4 ? "RungeKuttaClass4" :
+        (aStepper == StepperType::cRungeKuttaFehlberg45 ? "RungeKuttaFehlberg45" :
+        (aStepper == StepperType::cRungeKuttaCashKarp45 ? "RungeKuttaCashKarp45" :
+        (aStepper == StepperType::cRungeKuttaPrinceDormand89 ? "RungeKuttaPrinceDormand89" : "BulirschStoerBaderDeuflhard"))));
+}
+
+// Event counters of the solver and the ray tracing around it. They are collected per thread only when
+// compiled with SOLVER_STATISTICS, otherwise SOLVER_STATISTICS_ADD expands to nothing.
+struct SolverStatistics final {
+  enum Counter : uint32_t {
+    cAcceptedSteps    = 0u,
+    cRejectedSteps    = 1u,  // by the GSL step size control
+    cFailureHalvings  = 2u,  // after GSL_FAILURE, like when the ray went below the surface
+    cBigStepResets    = 3u,
+    cRestarts         = 4u,  // from the previous point with narrower interval or smaller step
+    cMaxStepHits      = 5u,
+    cStepMinInvalid   = 6u,
+    cExceptions       = 7u,
+    cCount            = 8u
+  };
+
+  static constexpr char const* csNames[cCount] = { "acceptedSteps", "rejectedSteps", "failureHalvings", "bigStepResets",
+                                                   "restarts", "maxStepHits", "stepMinInvalid", "exceptions" };
+
+  std::array<uint64_t, cCount> mCounts{};
+
+  SolverStatistics& operator+=(SolverStatistics const& aOther) {
+    for(uint32_t i = 0u; i < cCount; ++i) {
+      mCounts[i] += aOther.mCounts[i];
+    }
+    return *this;
+  }
+
+  SolverStatistics operator-(SolverStatistics const& aOther) const {
+    SolverStatistics result;
+    for(uint32_t i = 0u; i < cCount; ++i) {
+      result.mCounts[i] = mCounts[i] - aOther.mCounts[i];
+    }
+    return result;
+  }
+};
+
+#ifdef SOLVER_STATISTICS
+inline thread_local SolverStatistics gSolverStatistics;
+#define SOLVER_STATISTICS_ADD(aCounter, aValue) (gSolverStatistics.mCounts[SolverStatistics::aCounter] += (aValue))
+#else
+#define SOLVER_STATISTICS_ADD(aCounter, aValue)
+#endif
+
+// Largest step sizes of the first segments, which are the first one and those after big step resets, until
+// a judge change starts narrowing down, and where the judge changed. A neighbouring ray can start its
+// segments with these steps instead of ramping up from the initial step size, and can run its first
+// segments only until just before that end, to narrow down from there. The step size control still
+// rejects the steps if too big, and the judge still decides if the end came earlier.
+// Outside OdeSolverGsl, so solvers of different precision can share it.
+struct OdeStepSchedule final {
+  static constexpr uint32_t csLength = 8u;
+
+  std::array<double, csLength> mSteps;
+  uint32_t                     mCount = 0u;
+  double                       mEnd   = std::numeric_limits<double>::quiet_NaN();
+};
+
+// tReal is the arithmetic of the differentials, for tOdeDefinitions having them as template. The variables
+// stay double, because GSL works only in double.
+template <typename tOdeDefinition, typename tReal = double>
 class OdeSolverGsl final {
 public:
   static constexpr uint32_t csNvar = tOdeDefinition::csNvar;
   using Variables                  = std::array<double, csNvar>;
+  using Real                       = tReal;
+
+  static constexpr uint32_t csMaxStep = 31415u;
+  static constexpr uint32_t csScheduleLength = OdeStepSchedule::csLength;
+
+  static constexpr double   csApproachMargin = 1e-4;  // relative to the end of a hint
+
+  using StepSchedule = OdeStepSchedule;
 
   struct Result final {
-    bool      mValid;
-    double    mAtIndependent;
-    Variables mValue;
+    bool         mValid;
+    double       mAtIndependent;
+    Variables    mValue;
+    uint32_t     mStepCount;
+    StepSchedule mSchedule;
   };
 
 private:
   using OdeDefinition              = tOdeDefinition;
 
-  static constexpr uint32_t csMaxStep = 31415u;
-
   StepperType               mStepperType;
   double                    mTstart;
   double                    mTend;
@@ -59,11 +138,27 @@ public:
   OdeSolverGsl& operator=(OdeSolverGsl const&) = delete;
   OdeSolverGsl& operator=(OdeSolverGsl &&) = delete;
 
-  Result solve(Variables const &aYstart, std::function<bool(double const, Variables const&)> aJudge, std::function<bool(Variables const& aPrev, Variables const& aNow)> aDecide2resetBigStep);
+  // The result is invalid if the solution needs more than aMaxStep steps. aHint is the schedule of a similar solution.
+  // aJudge is like bool(double const aT, Variables const& aY), aDecide2resetBigStep like bool(Variables const& aPrev, Variables const& aNow).
+  // They are templates instead of std::function to keep the solution free of heap allocations.
+  template <typename tJudge, typename tDecide>
+  Result solve(Variables const &aYstart, tJudge &&aJudge, tDecide &&aDecide2resetBigStep,
+               uint32_t const aMaxStep = csMaxStep, StepSchedule const * const aHint = nullptr);
+
+private:
+  static int differentials(double aT, double const aY[], double aDydt[], void *aObject) {
+    auto object = reinterpret_cast<OdeDefinition*>(aObject);
+    if constexpr(std::is_same_v<tReal, double>) {
+      return object->differentials(aT, aY, aDydt);
+    }
+    else {
+      return object->template differentials<tReal>(aT, aY, aDydt);
+    }
+  }
 };
 
-template <typename tOdeDefinition>
-OdeSolverGsl<tOdeDefinition>::OdeSolverGsl(StepperType const aStepper, const double aTstart, const double aTend, const double aAtol, const double aRtol,
+template <typename tOdeDefinition, typename tReal>
+OdeSolverGsl<tOdeDefinition, tReal>::OdeSolverGsl(StepperType const aStepper, const double aTstart, const double aTend, const double aAtol, const double aRtol,
                                            const double aStepStart, double const aStepMin, double const aStepMax, OdeDefinition const& aOdeDef)
   : mStepperType(aStepper)
   , mTstart(aTstart)
@@ -97,10 +192,7 @@ OdeSolverGsl<tOdeDefinition>::OdeSolverGsl(StepperType const aStepper, const dou
   }
   else {} // nothing to do
 
-  mSystem.function = [](double aT, double const aY[], double aDydt[], void *aObject)->int {
-    auto object = reinterpret_cast<OdeDefinition*>(aObject);
-    return object->differentials(aT, aY, aDydt);
-  };
+  mSystem.function = differentials;
   mSystem.jacobian = [](double aT, double const aY[], double *aDfdy, double aDfdt[], void *aObject)->int {
     auto object = reinterpret_cast<OdeDefinition*>(aObject);
     return object->jacobian(aT, aY, aDfdy, aDfdt);
@@ -109,8 +201,8 @@ OdeSolverGsl<tOdeDefinition>::OdeSolverGsl(StepperType const aStepper, const dou
   mSystem.params = const_cast<OdeDefinition*>(&mOdeDef);
 }
 
-template <typename tOdeDefinition>
-OdeSolverGsl<tOdeDefinition>::OdeSolverGsl(OdeSolverGsl const& aOther)
+template <typename tOdeDefinition, typename tReal>
+OdeSolverGsl<tOdeDefinition, tReal>::OdeSolverGsl(OdeSolverGsl const& aOther)
   : mStepperType(aOther.mStepperType)
   , mTstart(aOther.mTstart)
   , mTend(aOther.mTend)
@@ -141,10 +233,7 @@ OdeSolverGsl<tOdeDefinition>::OdeSolverGsl(OdeSolverGsl const& aOther)
   }
   else {} // nothing to do
 
-  mSystem.function = [](double aT, double const aY[], double aDydt[], void *aObject)->int {
-    auto object = reinterpret_cast<OdeDefinition*>(aObject);
-    return object->differentials(aT, aY, aDydt);
-  };
+  mSystem.function = differentials;
   mSystem.jacobian = [](double aT, double const aY[], double *aDfdy, double aDfdt[], void *aObject)->int {
     auto object = reinterpret_cast<OdeDefinition*>(aObject);
     return object->jacobian(aT, aY, aDfdy, aDfdt);
@@ -153,32 +242,46 @@ OdeSolverGsl<tOdeDefinition>::OdeSolverGsl(OdeSolverGsl const& aOther)
   mSystem.params = const_cast<OdeDefinition*>(&mOdeDef);
 }
 
-template <typename tOdeDefinition>
-OdeSolverGsl<tOdeDefinition>::~OdeSolverGsl() {
+template <typename tOdeDefinition, typename tReal>
+OdeSolverGsl<tOdeDefinition, tReal>::~OdeSolverGsl() {
   gsl_odeiv2_evolve_free(mEvolver);
   gsl_odeiv2_control_free (mController);
   gsl_odeiv2_step_free(mStepper);
 }
 
-template <typename tOdeDefinition>
-typename OdeSolverGsl<tOdeDefinition>::Result OdeSolverGsl<tOdeDefinition>::solve(Variables const &aYstart,
-                                                                                  std::function<bool(double const, Variables const&)> aJudge,
-                                                                                  std::function<bool(Variables const& aPrev, Variables const& aNow)> aDecide2resetBigStep) {
+template <typename tOdeDefinition, typename tReal>
+template <typename tJudge, typename tDecide>
+typename OdeSolverGsl<tOdeDefinition, tReal>::Result OdeSolverGsl<tOdeDefinition, tReal>::solve(Variables const &aYstart,
+                                                                                         tJudge &&aJudge,
+                                                                                         tDecide &&aDecide2resetBigStep,
+                                                                                         uint32_t const aMaxStep,
+                                                                                         StepSchedule const * const aHint) {
   Result result;
   result.mValid = true;
   double start = mTstart;
   double end = mTend;
   Variables y = aYstart;
   uint32_t stepsAll = 0;
+  uint32_t segment = 0u;
+  bool narrowing = false;
+  double approach = std::numeric_limits<double>::infinity();
+  if(aHint != nullptr && std::isfinite(aHint->mEnd)) {
+    approach = aHint->mEnd - std::max(mStepStart, aHint->mEnd * csApproachMargin);
+  }
+  else {} // Nothing to do
   while(true) {
-    double h = mStepStart;
+    double h = (!narrowing && aHint != nullptr && segment < aHint->mCount ? std::max(mStepStart, aHint->mSteps[segment]) : mStepStart);
+    bool const hinted = (h > mStepStart);                                    // A single step from a hint is not precise enough to end.
+    double const segmentEnd = (!narrowing && approach < end ? approach : end);
+    double stepLargest = 0.0;
     double t = start;
     bool verdictPrev = aJudge(t, y);
     Variables yPrev;
     double tPrev;
     uint32_t stepsNow = 0;
     bool wasBigH = false;
-    while (t < end && stepsAll < csMaxStep) {
+    bool wasJudged = false;
+    while (t < segmentEnd && stepsAll < aMaxStep) {
       yPrev = y;
       tPrev = t;
       int status;
@@ -186,11 +289,16 @@ typename OdeSolverGsl<tOdeDefinition>::Result OdeSolverGsl<tOdeDefinition>::solv
       do {
         status = gsl_odeiv2_evolve_apply (mEvolver, mController, mStepper,
                                          &mSystem,
-                                         &t, end,
+                                         &t, segmentEnd,
                                          &h, y.data());
         h /= 2.0;
+        if(status == GSL_FAILURE) {
+          SOLVER_STATISTICS_ADD(cFailureHalvings, 1u);
+        }
+        else {} // Nothing to do
       } while(status == GSL_FAILURE);
       if (status != GSL_SUCCESS) {
+        SOLVER_STATISTICS_ADD(cRejectedSteps, mEvolver->failed_steps);
         gsl_odeiv2_evolve_reset(mEvolver);
         gsl_odeiv2_step_reset(mStepper);
         throw std::out_of_range("OdeSolverGsl: Can't apply step in evolver.");
@@ -198,29 +306,52 @@ typename OdeSolverGsl<tOdeDefinition>::Result OdeSolverGsl<tOdeDefinition>::solv
       else {} // Nothing to do
       ++stepsAll;
       ++stepsNow;
+      stepLargest = std::max(stepLargest, t - tPrev);
+      SOLVER_STATISTICS_ADD(cAcceptedSteps, 1u);
       if(h < mStepMin) {
+        SOLVER_STATISTICS_ADD(cStepMinInvalid, 1u);
         result.mValid = false;
         break;
       }
       else {} // Nothing to do
       if(verdictPrev != aJudge(t, y)) {
+        wasJudged = true;
         break;
       }
       else {} // Nothing to do
       if(h > mStepMax && aDecide2resetBigStep(yPrev, y)) {                    // If h is too big, it may make a too big step yielding false results GSL unable to detect.
+        SOLVER_STATISTICS_ADD(cBigStepResets, 1u);
         wasBigH = true;
         break;
       }
       else {} // Nothing to do
     }
+    SOLVER_STATISTICS_ADD(cRejectedSteps, mEvolver->failed_steps);
     gsl_odeiv2_evolve_reset(mEvolver);
     gsl_odeiv2_step_reset(mStepper);
-    if(!result.mValid || !wasBigH && stepsNow == 1u) {
+    if(!narrowing && segment < csScheduleLength) {
+      result.mSchedule.mSteps[segment] = std::min(stepLargest, mStepMax);
+      result.mSchedule.mCount = segment + 1u;
+    }
+    else {} // Nothing to do
+    if(result.mValid && !wasJudged && !wasBigH && segmentEnd < end && t >= segmentEnd) {
+      narrowing = true;                                                       // Just before the end of the hint, go on from here like narrowing.
+      ++segment;
+      start = t;
+    }
+    else if(!result.mValid || !wasBigH && !hinted && stepsNow == 1u) {
       result.mAtIndependent = t;
       result.mValue = y;
+      if(result.mValid) {
+        result.mSchedule.mEnd = t;
+      }
+      else {} // Nothing to do
       break;
     }
     else {
+      SOLVER_STATISTICS_ADD(cRestarts, 1u);
+      narrowing = narrowing || !wasBigH;
+      ++segment;
       y = yPrev;
       start = tPrev;
       if(!wasBigH) {
@@ -228,11 +359,13 @@ typename OdeSolverGsl<tOdeDefinition>::Result OdeSolverGsl<tOdeDefinition>::solv
       }
       else{} // nothing to do
     }
-    if(stepsAll == csMaxStep) {
+    if(stepsAll >= aMaxStep) {
+      SOLVER_STATISTICS_ADD(cMaxStepHits, 1u);
       result.mValid = false;
     }
     else {} // Nothing to do
   }
+  result.mStepCount = stepsAll;
   return result;
 }
 
@@ -0,0 +1,158 @@
+#include "Profiler.h"
+#include <ctime>
+#include <iomanip>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+
+PerfCounters::PerfCounters(bool const aInherit) {
+  mFds.fill(-1);
+#ifdef __linux__
+  std::array<uint64_t, csCount> const configs = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES };
+  for(uint32_t i = 0u; i < csCount; ++i) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = configs[i];
+    attr.disabled       = 1;
+    attr.inherit        = (aInherit ? 1 : 0);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    mFds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    if(mFds[i] >= 0) {
+      ioctl(mFds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(mFds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+    else {} // nothing to do
+  }
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+  for(auto fd : mFds) {
+    if(fd >= 0) {
+      close(fd);
+    }
+    else {} // nothing to do
+  }
+#endif
+}
+
+std::optional<PerfCounters::Values> PerfCounters::read() const {
+  std::optional<Values> result;
+#ifdef __linux__
+  Values values;
+  bool valid = true;
+  for(uint32_t i = 0u; i < csCount; ++i) {
+    valid = valid && mFds[i] >= 0 && ::read(mFds[i], &values[i], sizeof(uint64_t)) == sizeof(uint64_t);
+  }
+  if(valid) {
+    result = values;
+  }
+  else {} // nothing to do
+#endif
+  return result;
+}
+
+Profiler::ThreadScope::ThreadScope(Profiler &aProfiler, uint32_t const aIndex)
+  : mProfiler(aProfiler)
+  , mIndex(aIndex) {
+  if(mProfiler.mEnabled) {
+    mCounters.emplace(false);
+    mWallBegin = std::chrono::steady_clock::now();
+    mCpuBegin = getThreadCpuSeconds();
+  }
+  else {} // nothing to do
+}
+
+Profiler::ThreadScope::~ThreadScope() {
+  if(mProfiler.mEnabled) {
+    auto values = mCounters->read();
+    add(mProfiler.mThreads[mIndex], std::chrono::duration<double>(std::chrono::steady_clock::now() - mWallBegin).count(),
+        getThreadCpuSeconds() - mCpuBegin, values);
+  }
+  else {} // nothing to do
+}
+
+void Profiler::reset(bool const aEnabled, uint32_t const aThreadCount) {
+  mEnabled = aEnabled;
+  mPhases.clear();
+  mThreads.clear();
+  if(mEnabled) {
+    for(uint32_t i = 0u; i < aThreadCount; ++i) {
+      mThreads.push_back(Record{"thread " + std::to_string(i)});
+    }
+  }
+  else {} // nothing to do
+}
+
+double Profiler::getProcessCpuSeconds() {
+  timespec now;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+double Profiler::getThreadCpuSeconds() {
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void Profiler::add(Record &aRecord, double const aWallSeconds, double const aCpuSeconds, std::optional<PerfCounters::Values> const& aCounters) {
+  aRecord.mWallSeconds += aWallSeconds;
+  aRecord.mCpuSeconds += aCpuSeconds;
+  if(aCounters && (aRecord.mSamples == 0u || aRecord.mCounters)) {
+    if(!aRecord.mCounters) {
+      aRecord.mCounters = PerfCounters::Values{};
+    }
+    else {} // nothing to do
+    for(uint32_t i = 0u; i < PerfCounters::csCount; ++i) {
+      (*aRecord.mCounters)[i] += (*aCounters)[i];
+    }
+  }
+  else {
+    aRecord.mCounters.reset();   // Partial counts would be misleading.
+  }
+  ++aRecord.mSamples;
+}
+
+void Profiler::print(std::ostream &aOut) const {
+  if(mEnabled) {
+    aOut << std::setw(28) << std::left << "phase" << std::right << std::setw(12) << "wall (s)" << std::setw(12) << "CPU (s)";
+    for(auto name : PerfCounters::csNames) {
+      aOut << std::setw(14) << name;
+    }
+    aOut << '\n';
+    for(auto const& phase : mPhases) {
+      print(aOut, phase);
+    }
+    for(auto const& thread : mThreads) {
+      if(thread.mWallSeconds > 0.0) {
+        print(aOut, thread);
+      }
+      else {} // nothing to do
+    }
+  }
+  else {} // nothing to do
+}
+
+void Profiler::print(std::ostream &aOut, Record const& aRecord) {
+  aOut << std::setw(28) << std::left << aRecord.mName << std::right << std::fixed << std::setprecision(6)
+       << std::setw(12) << aRecord.mWallSeconds << std::setw(12) << aRecord.mCpuSeconds;
+  for(uint32_t i = 0u; i < PerfCounters::csCount; ++i) {
+    if(aRecord.mCounters) {
+      aOut << std::setw(14) << (*aRecord.mCounters)[i];
+    }
+    else {
+      aOut << std::setw(14) << "n/a";
+    }
+  }
+  aOut << std::defaultfloat << '\n';
+}
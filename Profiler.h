@@ -0,0 +1,118 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// Hardware counters via perf_event_open, only on Linux and only if the kernel lets us
+// (see /proc/sys/kernel/perf_event_paranoid). With aInherit the threads created later
+// by the calling one are also counted, once they are joined.
+class PerfCounters final {
+public:
+  static constexpr uint32_t csCount = 3u;
+  static constexpr char const* csNames[csCount] = { "cycles", "instructions", "cache misses" };
+  using Values = std::array<uint64_t, csCount>;
+
+private:
+  std::array<int, csCount> mFds;
+
+public:
+  PerfCounters(bool const aInherit);
+  ~PerfCounters();
+  PerfCounters(PerfCounters const&) = delete;
+  PerfCounters& operator=(PerfCounters const&) = delete;
+
+  std::optional<Values> read() const;
+};
+
+// Wall time, process or thread CPU time and hardware counters of named phases and of worker threads.
+// Does nothing unless enabled, so the phases can be wrapped unconditionally.
+class Profiler final {
+public:
+  struct Record {
+    std::string           mName;
+    double                mWallSeconds = 0.0;
+    double                mCpuSeconds  = 0.0;
+    uint32_t              mSamples     = 0u;
+    std::optional<PerfCounters::Values> mCounters = std::nullopt;
+  };
+
+  // Measures the calling worker thread from construction to destruction into slot aIndex of the
+  // thread records, accumulating when the same slot is measured more times.
+  class ThreadScope final {
+  private:
+    Profiler                             &mProfiler;
+    uint32_t const                        mIndex;
+    std::optional<PerfCounters>           mCounters;
+    std::chrono::steady_clock::time_point mWallBegin;
+    double                                mCpuBegin;
+
+  public:
+    ThreadScope(Profiler &aProfiler, uint32_t const aIndex);
+    ~ThreadScope();
+  };
+
+private:
+  bool                mEnabled = false;
+  std::vector<Record> mPhases;   // In order of the first appearance of the name
+  std::vector<Record> mThreads;
+  std::mutex          mMutex;    // Phases may run concurrently.
+
+public:
+  // Clears the records.
+  void reset(bool const aEnabled, uint32_t const aThreadCount);
+  bool isEnabled() const { return mEnabled; }
+
+  // Calls aFunction, measuring it into the phase aName. Phases with the same name are summed up.
+  // The CPU time is that of the whole process, so concurrent phases include each other's.
+  template <typename tFunction>
+  void measure(char const * const aName, tFunction &&aFunction);
+
+  void print(std::ostream &aOut) const;
+
+  static double getProcessCpuSeconds();
+  static double getThreadCpuSeconds();
+
+private:
+  static void add(Record &aRecord, double const aWallSeconds, double const aCpuSeconds, std::optional<PerfCounters::Values> const& aCounters);
+  static void print(std::ostream &aOut, Record const& aRecord);
+};
+
+template <typename tFunction>
+void Profiler::measure(char const * const aName, tFunction &&aFunction) {
+  if(mEnabled) {
+    PerfCounters counters(true);
+    auto wallBegin = std::chrono::steady_clock::now();
+    auto cpuBegin = getProcessCpuSeconds();
+    aFunction();
+    auto values = counters.read();
+    auto cpuSeconds = getProcessCpuSeconds() - cpuBegin;
+    auto wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallBegin).count();
+    std::lock_guard<std::mutex> lock(mMutex);
+    Record *record = nullptr;
+    for(auto &phase : mPhases) {
+      if(phase.mName == aName) {
+        record = &phase;
+      }
+      else {} // nothing to do
+    }
+    if(record == nullptr) {
+      mPhases.push_back(Record{aName});
+      record = &mPhases.back();
+    }
+    else {} // nothing to do
+    add(*record, wallSeconds, cpuSeconds, values);
+  }
+  else {
+    aFunction();
+  }
+}
+
+#endif // PROFILER_H
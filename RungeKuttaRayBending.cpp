@@ -1,51 +1,73 @@
 ﻿#include "RungeKuttaRayBending.h"
 #include <cmath>
+#include <limits>
 
 
-RungeKuttaRayBending::Result RungeKuttaRayBending::solve4xFlat(Vertex const &aStart, Vector const &aDir, double const aX) {
-  typename Eikonal::Variables start;
-  start[0u] = aStart(0u);
-  start[1u] = aStart(1u);
-  start[2u] = aStart(2u);
-  auto slowness = mDiffEq.getSlowness(aStart(1u));  // from height
-  start[3u] = aDir(0u) * slowness;
-  start[4u] = aDir(1u) * slowness;
-  start[5u] = aDir(2u) * slowness;
-  auto solution = mSolver.solve(start,
-      [aX](double const, typename Eikonal::Variables const& aY){ return aY[0] >= aX; },
-    [this](typename Eikonal::Variables const& aYprev, typename Eikonal::Variables const& aYnow) { return decide2resetBigStep(aYprev, aYnow); });
-  Result result;
-  result.mValid = solution.mValid;
-  result.mValue(0u) = solution.mValue[0u];
-  result.mValue(1u) = solution.mValue[1u];
-  result.mValue(2u) = solution.mValue[2u];
-  result.mDirection(0u) = solution.mValue[3u];
-  result.mDirection(1u) = solution.mValue[4u];
-  result.mDirection(2u) = solution.mValue[5u];
-  result.mDirection.normalize();
-  return result;
+RungeKuttaRayBending::Result RungeKuttaRayBending::solve4x(Vertex const &aStart, Vector const &aDir, double const aX, uint32_t const aMaxStep, StepSchedule const * const aHint) {
+  auto state = getState(aStart, aDir);
+  return solve4x(state, aMaxStep, aHint,
+      [aX](double const, Eikonal::Variables const& aY){ return aY[0] >= aX; });     // For round Earth we now neglect the variation in perpendicular along the travelled distance.
 }
 
-RungeKuttaRayBending::Result RungeKuttaRayBending::solve4xRound(Vertex const &aStart, Vector const &aDir, double const aX) {
-  typename Eikonal::Variables start;
-  start[0u] = aStart(0u);
-  start[1u] = aStart(1u) + mDiffEq.getEarthRadius();
-  start[2u] = aStart(2u);
+RungeKuttaRayBending::State RungeKuttaRayBending::getState(Vertex const &aStart, Vector const &aDir) const {
+  State result;
+  result[0u] = aStart(0u);
+  result[1u] = aStart(1u) + getShift();
+  result[2u] = aStart(2u);
   auto slowness = mDiffEq.getSlowness(aStart(1u));  // from height
-  start[3u] = aDir(0u) * slowness;
-  start[4u] = aDir(1u) * slowness;
-  start[5u] = aDir(2u) * slowness;
-  auto solution = mSolver.solve(start,
-      [aX](double const, typename Eikonal::Variables const& aY){ return aY[0] >= aX; },     // We now neglect the variation in perpendicular along the travelled distance.
-    [this](typename Eikonal::Variables const& aYprev, typename Eikonal::Variables const& aYnow) { return decide2resetBigStep(aYprev, aYnow); });
-  Result result;
-  result.mValid = solution.mValid;
-  result.mValue(0u) = solution.mValue[0u];
-  result.mValue(1u) = solution.mValue[1u] - mDiffEq.getEarthRadius();
-  result.mValue(2u) = solution.mValue[2u];
-  result.mDirection(0u) = solution.mValue[3u];
-  result.mDirection(1u) = solution.mValue[4u];
-  result.mDirection(2u) = solution.mValue[5u];
-  result.mDirection.normalize();
+  result[3u] = aDir(0u) * slowness;
+  result[4u] = aDir(1u) * slowness;
+  result[5u] = aDir(2u) * slowness;
   return result;
 }
+
+RungeKuttaRayBending::Result RungeKuttaRayBending::solve4x(State &aState, double const aX, uint32_t const aMaxStep, StepSchedule const * const aHint,
+                                                           Window const * const aWindows, uint32_t const aWindowCount) {
+  double const shift = getShift();
+  double const nan = std::numeric_limits<double>::quiet_NaN();
+  Vertex previous(nan, nan, nan);          // where the judge was called last, going back when the solver restarts
+  Vector dirPrevious(nan, nan, nan);
+  return solve4x(aState, aMaxStep, aHint, [aX, aWindows, aWindowCount, shift, &previous, &dirPrevious](double const, Eikonal::Variables const& aY) {
+    Vertex now(aY[0u], aY[1u] - shift, aY[2u]);
+    Vector dir(aY[3u], aY[4u], aY[5u]);
+    dir.normalize();
+    bool result = (now(0u) >= aX);
+    for(uint32_t i = 0u; i < aWindowCount && !result; ++i) {
+      auto const& window = aWindows[i];
+      if(previous(0u) < window.mX && window.mX <= now(0u)) {
+        Vector chord = now - previous;
+        Vertex cross = previous + chord * ((window.mX - previous(0u)) / chord(0u));
+        double const margin = chord.norm() * (dir - dirPrevious).norm();   // The arc stays closer to the chord.
+        result = cross(1u) + margin > window.mMinY && cross(1u) - margin < window.mMaxY && cross(2u) + margin > window.mMinZ && cross(2u) - margin < window.mMaxZ;
+      }
+      else {} // nothing to do
+    }
+    previous = now;
+    dirPrevious = dir;
+    return result;
+  });
+}
+
+template <typename tJudge>
+RungeKuttaRayBending::Result RungeKuttaRayBending::solve4x(State &aState, uint32_t const aMaxStep, StepSchedule const * const aHint, tJudge &&aJudge) {
+  double const shift = getShift();
+  auto solve = [this, &aState, aMaxStep, aHint, &aJudge, shift](auto &aSolver) {
+    auto solution = aSolver.solve(aState, aJudge,
+      [this](Eikonal::Variables const& aYprev, Eikonal::Variables const& aYnow) { return decide2resetBigStep(aYprev, aYnow); },
+      aMaxStep, aHint);
+    aState = solution.mValue;
+    Result result;
+    result.mValid = solution.mValid;
+    result.mStepCount = solution.mStepCount;
+    result.mSchedule = solution.mSchedule;
+    result.mValue(0u) = solution.mValue[0u];
+    result.mValue(1u) = solution.mValue[1u] - shift;
+    result.mValue(2u) = solution.mValue[2u];
+    result.mDirection(0u) = solution.mValue[3u];
+    result.mDirection(1u) = solution.mValue[4u];
+    result.mDirection(2u) = solution.mValue[5u];
+    result.mDirection.normalize();
+    return result;
+  };
+  return mSolverMixed ? solve(*mSolverMixed) : solve(mSolver);
+}
@@ -5,15 +5,27 @@
 #include "3dGeomUtil.h"
 #include "Eikonal.h"
 #include "OdeSolverGsl.h"
+#include <optional>
 
 
 class RungeKuttaRayBending final {
+public:
+  // With cMixed the differentials are evaluated in float, see Eikonal::differentials.
+  enum class Precision : uint8_t {
+    cDouble = 0u,
+    cMixed  = 1u
+  };
+
 private:
-  Eikonal const        &mDiffEq;
-  OdeSolverGsl<Eikonal> mSolver;
-  double                mMaxCosDirChange;
+  Eikonal const                               &mDiffEq;
+  OdeSolverGsl<Eikonal>                        mSolver;
+  std::optional<OdeSolverGsl<Eikonal, float>>  mSolverMixed;  // only for cMixed
+  double                                       mMaxCosDirChange;
 
 public:
+  static constexpr uint32_t csMaxStep = OdeSolverGsl<Eikonal>::csMaxStep;
+  using StepSchedule = OdeStepSchedule;
+
   struct Parameters {
     StepperType mStepper;
     double      mDistAlongRay;
@@ -23,19 +35,40 @@ public:
     double      mStepMin;
     double      mStepMax;
     double      mMaxCosDirChange;
+    Precision   mPrecision = Precision::cDouble;
   };
 
   struct Result {
-    bool   mValid;
-    Vertex mValue;
-    Vector mDirection;
+    bool         mValid;
+    Vertex       mValue;
+    Vector       mDirection;
+    uint32_t     mStepCount;
+    StepSchedule mSchedule;
   };
 
+  // A rectangle in the plane at mX, where solve4x may end a ray before its target plane.
+  struct Window {
+    double mX;
+    double mMinY;
+    double mMaxY;
+    double mMinZ;
+    double mMaxZ;
+  };
+
+  // The variables of the solver along a ray, to go on with the same momentum where it ended.
+  using State = Eikonal::Variables;
+
   RungeKuttaRayBending(Parameters const &aParameters, Eikonal const &aDiffEq)
     : mDiffEq(aDiffEq)
     , mSolver(aParameters.mStepper, 0.0, aParameters.mDistAlongRay, aParameters.mTolAbs, aParameters.mTolRel,
               aParameters.mStep1, aParameters.mStepMin, aParameters.mStepMax, aDiffEq)
-    , mMaxCosDirChange(aParameters.mMaxCosDirChange) {}
+    , mMaxCosDirChange(aParameters.mMaxCosDirChange) {
+    if(aParameters.mPrecision == Precision::cMixed) {
+      mSolverMixed.emplace(aParameters.mStepper, 0.0, aParameters.mDistAlongRay, aParameters.mTolAbs, aParameters.mTolRel,
+                           aParameters.mStep1, aParameters.mStepMin, aParameters.mStepMax, aDiffEq);
+    }
+    else {} // nothing to do
+  }
 
   RungeKuttaRayBending(RungeKuttaRayBending const&) = default;
   RungeKuttaRayBending(RungeKuttaRayBending &&) = delete;
@@ -44,13 +77,28 @@ public:
 
   double getRefract(double const aH) const { return mDiffEq.getRefract(aH); }
 
-  Result solve4x(Vertex const &aStart, Vector const &aDir, double const aX) {
-    return mDiffEq.getEarthForm() == Eikonal::EarthForm::cFlat ? solve4xFlat(aStart, aDir, aX) : solve4xRound(aStart, aDir, aX);
-  }
+  // The result is invalid if the ray needs more than aMaxStep steps to reach aX. aHint is the mSchedule of a neighbouring ray.
+  Result solve4x(Vertex const &aStart, Vector const &aDir, double const aX, uint32_t const aMaxStep = csMaxStep, StepSchedule const * const aHint = nullptr);
+
+  // The state at aStart in direction aDir for the solve4x below.
+  State getState(Vertex const &aStart, Vector const &aDir) const;
+
+  // Goes on from aState like the above, but also ends the ray where the chord of a step crosses one of the
+  // aWindowCount aWindows, widened by the chord length times the direction change along it. Until then the steps
+  // are the same as without windows. aState is the end afterwards, to go on from there if the ray ended only near
+  // a window.
+  Result solve4x(State &aState, double const aX, uint32_t const aMaxStep, StepSchedule const * const aHint,
+                 Window const * const aWindows, uint32_t const aWindowCount);
 
 private:
-  Result solve4xFlat(Vertex const &aStart, Vector const &aDir, double const aX);
-  Result solve4xRound(Vertex const &aStart, Vector const &aDir, double const aX);
+  // For round Earth the state is shifted by the Earth radius in double, see Eikonal::differentials.
+  double getShift() const {
+    return (mDiffEq.getEarthForm() == Eikonal::EarthForm::cRound && !mSolverMixed ? mDiffEq.getEarthRadius() : 0.0);
+  }
+
+  // aJudge is like in OdeSolverGsl::solve.
+  template <typename tJudge>
+  Result solve4x(State &aState, uint32_t const aMaxStep, StepSchedule const * const aHint, tJudge &&aJudge);
 
   bool decide2resetBigStep(typename Eikonal::Variables const& aYprev, typename Eikonal::Variables const& aYnow) {
     Vector dirPrev(aYprev[3u], aYprev[4u], aYprev[5u]);
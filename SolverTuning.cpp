@@ -0,0 +1,258 @@
+#include "SolverTuning.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+
+SolverTuning::SolverTuning(Scene const& aScene, RungeKuttaRayBending::Parameters const& aBase, uint32_t const aRayCount)
+  : mScene(aScene)
+  , mEikonal(aScene.mEarthForm, aScene.mEarthRadius, aScene.mModel, aScene.mTempAmb, aScene.mTempAmbMin, aScene.mTempAmbMax, aScene.mTempBase)
+  , mReferenceParameters(aBase) {
+  mReferenceParameters.mStepper         = StepperType::cRungeKuttaPrinceDormand89;
+  mReferenceParameters.mTolAbs          = 1e-12;
+  mReferenceParameters.mTolRel          = 1e-12;
+  mReferenceParameters.mStep1           = 1e-3;
+  mReferenceParameters.mStepMin         = 1e-12;
+  mReferenceParameters.mStepMax         = 5.0;
+  mReferenceParameters.mMaxCosDirChange = 0.999999999999;
+  sampleDirections(aRayCount);
+  RungeKuttaRayBending reference(mReferenceParameters, mEikonal);
+  for(auto const& direction : mDirections) {
+    mReference.push_back(solve(reference, direction));
+  }
+}
+
+RungeKuttaRayBending::Result SolverTuning::solve(RungeKuttaRayBending &aSolver, Vector const& aDirection) const {
+  RungeKuttaRayBending::Result result;
+  try {
+    result = aSolver.solve4x(Vertex(0.0, mScene.mCamCenter, 0.0), aDirection, mScene.mDist);
+  }
+  catch(std::exception &) {
+    result.mValid = false;
+  }
+  return result;
+}
+
+void SolverTuning::sampleDirections(uint32_t const aRayCount) {
+  RungeKuttaRayBending reference(mReferenceParameters, mEikonal);
+  auto getDirection = [](double const aAngleY, double const aAngleZ) {
+    return Vector(std::cos(aAngleY) * std::cos(aAngleZ), std::sin(aAngleY), std::cos(aAngleY) * std::sin(aAngleZ));
+  };
+  auto critical = binarySearch(csSearchLow, 0.0, csSearchEpsilon, [this, &reference, &getDirection](double const aAngle) {
+    return solve(reference, getDirection(aAngle, 0.0)).mValid;
+  }) + csSearchEpsilon;
+  double shift = (mScene.mEarthForm == Eikonal::EarthForm::cFlat ? 0.0 : std::sqrt(mScene.mEarthRadius * mScene.mEarthRadius - mScene.mDist * mScene.mDist) - mScene.mEarthRadius);
+  auto bottom = std::atan((mScene.mBullLift + shift - mScene.mCamCenter) / mScene.mDist);
+  auto top = std::atan((mScene.mBullLift + mScene.mHeight + shift - mScene.mCamCenter) / mScene.mDist);
+  auto mirrorEnd = (bottom > critical + csNearCritical ? bottom : critical + 10.0 * csNearCritical);
+  auto halfWidth = std::atan(mScene.mWidth / 2.0 / mScene.mDist);
+
+  // Share of rays, lower and upper vertical angle.
+  std::array<std::array<double, 3u>, 5u> const categories {{
+    { 0.10, critical - csOutsideMargin, critical },                 // ground
+    { 0.15, critical, critical + csNearCritical },                  // near-critical
+    { 0.25, critical + csNearCritical, mirrorEnd },                 // mirror band
+    { 0.40, std::max(mirrorEnd, bottom), std::max(mirrorEnd, top) },// billboard
+    { 0.10, std::max(mirrorEnd, top), std::max(mirrorEnd, top) + csOutsideMargin } // sky
+  }};
+  uint32_t index = 0u;
+  for(auto const& category : categories) {
+    uint32_t count = std::max(1u, static_cast<uint32_t>(std::round(category[0] * aRayCount)));
+    for(uint32_t i = 0u; i < count; ++i) {
+      auto angleY = category[1] + (category[2] - category[1]) * (i + 0.5) / count;
+      auto golden = (index * 0.6180339887498949) - std::floor(index * 0.6180339887498949);
+      mDirections.push_back(getDirection(angleY, halfWidth * (golden * 2.0 - 1.0)));
+      ++index;
+    }
+  }
+}
+
+SolverTuning::Candidate SolverTuning::evaluate(RungeKuttaRayBending::Parameters const& aParameters) const {
+  std::vector<RungeKuttaRayBending::Result> hits;
+  auto result = measure(aParameters, hits);
+  compare(hits, mReference, result);
+  return result;
+}
+
+SolverTuning::Candidate SolverTuning::evaluateMixed(RungeKuttaRayBending::Parameters const& aParameters) const {
+  auto parameters = aParameters;
+  parameters.mPrecision = RungeKuttaRayBending::Precision::cDouble;
+  std::vector<RungeKuttaRayBending::Result> against;
+  measure(parameters, against);
+  parameters.mPrecision = RungeKuttaRayBending::Precision::cMixed;
+  std::vector<RungeKuttaRayBending::Result> hits;
+  auto result = measure(parameters, hits);
+  compare(hits, against, result);
+  return result;
+}
+
+SolverTuning::Candidate SolverTuning::measure(RungeKuttaRayBending::Parameters const& aParameters, std::vector<RungeKuttaRayBending::Result> &aHits) const {
+  Candidate result;
+  result.mParameters = aParameters;
+  RungeKuttaRayBending solver(aParameters, mEikonal);
+  aHits.resize(mDirections.size());
+  double seconds = std::numeric_limits<double>::max();
+  for(uint32_t r = 0u; r < csTimingRepeat; ++r) {
+    auto begin = std::chrono::steady_clock::now();
+    for(uint32_t i = 0u; i < mDirections.size(); ++i) {
+      aHits[i] = solve(solver, mDirections[i]);
+    }
+    seconds = std::min(seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+  }
+  result.mRaysPerSecond = mDirections.size() / seconds;
+  return result;
+}
+
+void SolverTuning::compare(std::vector<RungeKuttaRayBending::Result> const& aHits, std::vector<RungeKuttaRayBending::Result> const& aAgainst, Candidate &aCandidate) const {
+  std::vector<double> errors;
+  uint32_t mismatches = 0u;
+  for(uint32_t i = 0u; i < mDirections.size(); ++i) {
+    if(aHits[i].mValid && aAgainst[i].mValid) {
+      errors.push_back(std::hypot(aHits[i].mValue(1) - aAgainst[i].mValue(1), aHits[i].mValue(2) - aAgainst[i].mValue(2)) / mScene.mTexelSize);
+    }
+    else if(aHits[i].mValid != aAgainst[i].mValid) {
+      ++mismatches;
+    }
+    else {} // nothing to do
+  }
+  std::sort(errors.begin(), errors.end());
+  aCandidate.mError95 = (errors.empty() ? 0.0 : errors[static_cast<uint32_t>(std::ceil(0.95 * errors.size())) - 1u]);
+  aCandidate.mErrorMax = (errors.empty() ? 0.0 : errors.back());
+  aCandidate.mMismatchRatio = static_cast<double>(mismatches) / mDirections.size();
+}
+
+std::vector<RungeKuttaRayBending::Parameters> SolverTuning::getCandidateGrid(RungeKuttaRayBending::Parameters const& aBase) {
+  std::vector<RungeKuttaRayBending::Parameters> result;
+  // BulirschStoerBaderDeuflhard is left out, because it needs the Jacobian, which is known to be wrong.
+  for(auto stepper : { StepperType::cRungeKutta23, StepperType::cRungeKuttaClass4, StepperType::cRungeKuttaFehlberg45,
+                       StepperType::cRungeKuttaCashKarp45, StepperType::cRungeKuttaPrinceDormand89 }) {
+    for(auto tolerance : { 1e-2, 1e-3, 1e-4, 1e-5, 1e-6 }) {
+      for(auto stepMax : { 11.1, 22.2, 55.5 }) {
+        for(auto maxCosDirChange : { 0.9999999999, 0.99999999999, 0.999999999999 }) {
+          auto parameters = aBase;
+          parameters.mStepper         = stepper;
+          parameters.mTolAbs          = tolerance;
+          parameters.mTolRel          = tolerance;
+          parameters.mStepMax         = stepMax;
+          parameters.mMaxCosDirChange = maxCosDirChange;
+          result.push_back(parameters);
+        }
+      }
+    }
+  }
+  return result;
+}
+
+std::vector<SolverTuning::Candidate> SolverTuning::getParetoFrontier(std::vector<Candidate> const& aCandidates) {
+  std::vector<Candidate> result;
+  for(auto const& candidate : aCandidates) {
+    bool dominated = std::any_of(aCandidates.begin(), aCandidates.end(), [&candidate](auto const& aOther) {
+      return aOther.mRaysPerSecond >= candidate.mRaysPerSecond && aOther.mError95 <= candidate.mError95 && aOther.mMismatchRatio <= candidate.mMismatchRatio &&
+            (aOther.mRaysPerSecond > candidate.mRaysPerSecond || aOther.mError95 < candidate.mError95 || aOther.mMismatchRatio < candidate.mMismatchRatio);
+    });
+    if(!dominated) {
+      result.push_back(candidate);
+    }
+    else {} // nothing to do
+  }
+  std::sort(result.begin(), result.end(), [](auto const& aLeft, auto const& aRight) { return aLeft.mRaysPerSecond > aRight.mRaysPerSecond; });
+  return result;
+}
+
+SolverTuning::Candidate const* SolverTuning::getCheapest(std::vector<Candidate> const& aCandidates, double const aTargetError, double const aTargetMismatchRatio) {
+  Candidate const* result = nullptr;
+  for(auto const& candidate : aCandidates) {
+    if(candidate.mError95 <= aTargetError && candidate.mMismatchRatio <= aTargetMismatchRatio &&
+      (result == nullptr || candidate.mRaysPerSecond > result->mRaysPerSecond)) {
+      result = &candidate;
+    }
+    else {} // nothing to do
+  }
+  return result;
+}
+
+std::optional<SolverTuning::Candidate> SolverTuning::tune(RungeKuttaRayBending::Parameters const& aBase, double const aTargetError, double const aTargetMismatchRatio) const {
+  std::vector<Candidate> candidates;
+  for(auto const& parameters : getCandidateGrid(aBase)) {
+    candidates.push_back(evaluate(parameters));
+  }
+  std::optional<Candidate> result;
+  auto cheapest = getCheapest(candidates, aTargetError, aTargetMismatchRatio);
+  if(cheapest != nullptr) {
+    result = *cheapest;
+    candidates.clear();
+    for(auto factor : csStep1Factors) {
+      auto parameters = result->mParameters;
+      parameters.mStep1 *= factor;
+      candidates.push_back(evaluate(parameters));
+    }
+    cheapest = getCheapest(candidates, aTargetError, aTargetMismatchRatio);
+    if(cheapest != nullptr && cheapest->mRaysPerSecond > result->mRaysPerSecond) {
+      result = *cheapest;
+    }
+    else {} // nothing to do
+  }
+  else {} // nothing to do
+  return result;
+}
+
+uint64_t SolverTuning::getHash(Scene const& aScene, RungeKuttaRayBending::Parameters const& aBase, uint32_t const aRayCount,
+                               double const aTargetError, double const aTargetMismatchRatio) {
+  uint64_t result = 14695981039346656037u;  // FNV-1a
+  auto add = [&result](auto const aValue) {
+    unsigned char bytes[sizeof(aValue)];
+    std::memcpy(bytes, &aValue, sizeof(aValue));
+    for(auto byte : bytes) {
+      result = (result ^ byte) * 1099511628211u;
+    }
+  };
+  add(aScene.mEarthForm);
+  add(aScene.mEarthRadius);
+  add(aScene.mModel);
+  add(aScene.mTempAmb);
+  add(aScene.mTempAmbMin);
+  add(aScene.mTempAmbMax);
+  add(aScene.mTempBase);
+  add(aScene.mCamCenter);
+  add(aScene.mDist);
+  add(aScene.mBullLift);
+  add(aScene.mHeight);
+  add(aScene.mWidth);
+  add(aScene.mTexelSize);
+  add(aBase.mDistAlongRay);
+  add(aBase.mStep1);
+  add(aBase.mStepMin);
+  add(aRayCount);
+  add(aTargetError);
+  add(aTargetMismatchRatio);
+  return result;
+}
+
+std::optional<RungeKuttaRayBending::Parameters> SolverTuning::loadCached(std::string const& aName, uint64_t const aHash, RungeKuttaRayBending::Parameters const& aBase) {
+  std::optional<RungeKuttaRayBending::Parameters> result;
+  std::ifstream in(aName);
+  std::string line;
+  while(std::getline(in, line)) {
+    std::istringstream fields(line);
+    uint64_t hash;
+    uint32_t stepper;
+    auto parameters = aBase;
+    if(fields >> std::hex >> hash >> std::dec >> stepper >> parameters.mTolAbs >> parameters.mTolRel >> parameters.mStep1 >> parameters.mStepMax >> parameters.mMaxCosDirChange
+       && hash == aHash) {
+      parameters.mStepper = static_cast<StepperType>(stepper);
+      result = parameters;
+    }
+    else {} // nothing to do
+  }
+  return result;
+}
+
+void SolverTuning::storeCached(std::string const& aName, uint64_t const aHash, RungeKuttaRayBending::Parameters const& aParameters) {
+  std::ofstream out(aName, std::ios::app);
+  out << std::hex << aHash << std::dec << ' ' << static_cast<uint32_t>(aParameters.mStepper) << std::setprecision(17)
+      << ' ' << aParameters.mTolAbs << ' ' << aParameters.mTolRel << ' ' << aParameters.mStep1 << ' ' << aParameters.mStepMax << ' ' << aParameters.mMaxCosDirChange << '\n';
+}
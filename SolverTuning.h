@@ -0,0 +1,90 @@
+#ifndef SOLVERTUNING_H
+#define SOLVERTUNING_H
+
+#include "RungeKuttaRayBending.h"
+#include <optional>
+#include <string>
+#include <vector>
+
+
+// Measures hit position errors and speed of solver settings on a fixed ray set of a scene, compared to the hits
+// of a reference solution computed at extreme tolerance. GSL works only in double, so the reference is not
+// more precise in number representation, only in step control.
+class SolverTuning final {
+public:
+  struct Scene {
+    Eikonal::EarthForm mEarthForm;
+    double             mEarthRadius;  // m
+    Eikonal::Model     mModel;
+    double             mTempAmb;
+    double             mTempAmbMin;
+    double             mTempAmbMax;
+    double             mTempBase;
+    double             mCamCenter;
+    double             mDist;
+    double             mBullLift;
+    double             mHeight;
+    double             mWidth;
+    double             mTexelSize;    // m, to express errors in billboard pixels
+  };
+
+  struct Candidate {
+    RungeKuttaRayBending::Parameters mParameters;
+    double                           mError95;        // billboard pixels, 95th percentile of rays valid in both
+    double                           mErrorMax;       // billboard pixels
+    double                           mMismatchRatio;  // of rays valid in only one of the solution and reference
+    double                           mRaysPerSecond;
+  };
+
+private:
+  static constexpr double   csSearchEpsilon     = 1e-9;    // radians
+  static constexpr double   csSearchLow         = -0.05;   // radians, surely hitting the ground
+  static constexpr double   csOutsideMargin     = 0.002;   // radians, for rays hitting the ground or going to the sky
+  static constexpr double   csNearCritical      = 1e-5;    // radians above the critical angle
+  static constexpr uint32_t csTimingRepeat      = 3u;
+  static constexpr double   csStep1Factors[]    = { 0.1, 1.0, 10.0 };
+
+  Scene                                     const mScene;
+  Eikonal                                         mEikonal;
+  RungeKuttaRayBending::Parameters                mReferenceParameters;
+  std::vector<Vector>                             mDirections;
+  std::vector<RungeKuttaRayBending::Result>       mReference;
+
+public:
+  // Samples aRayCount directions: ground, near-critical, mirror band, billboard and sky.
+  SolverTuning(Scene const& aScene, RungeKuttaRayBending::Parameters const& aBase, uint32_t const aRayCount);
+
+  Candidate evaluate(RungeKuttaRayBending::Parameters const& aParameters) const;
+
+  // Like evaluate, but aParameters in mixed precision compared to the same in double instead of the reference.
+  Candidate evaluateMixed(RungeKuttaRayBending::Parameters const& aParameters) const;
+
+  // Steppers, tolerances, maximal step sizes and direction change limits around aBase.
+  static std::vector<RungeKuttaRayBending::Parameters> getCandidateGrid(RungeKuttaRayBending::Parameters const& aBase);
+
+  // Candidates not beaten by an other one in all of speed, error and mismatch ratio, fastest first.
+  static std::vector<Candidate> getParetoFrontier(std::vector<Candidate> const& aCandidates);
+
+  // Fastest candidate meeting the targets, or nullptr.
+  static Candidate const* getCheapest(std::vector<Candidate> const& aCandidates, double const aTargetError, double const aTargetMismatchRatio);
+
+  // Searches the candidate grid, then the initial step size of the winner. Empty if nothing meets the targets.
+  std::optional<Candidate> tune(RungeKuttaRayBending::Parameters const& aBase, double const aTargetError, double const aTargetMismatchRatio) const;
+
+  // Identifies everything tune depends on, to be used as cache key.
+  static uint64_t getHash(Scene const& aScene, RungeKuttaRayBending::Parameters const& aBase, uint32_t const aRayCount,
+                          double const aTargetError, double const aTargetMismatchRatio);
+
+  // The cache is a text file with a line for each hash, holding the tuned parameters.
+  static std::optional<RungeKuttaRayBending::Parameters> loadCached(std::string const& aName, uint64_t const aHash, RungeKuttaRayBending::Parameters const& aBase);
+  static void storeCached(std::string const& aName, uint64_t const aHash, RungeKuttaRayBending::Parameters const& aParameters);
+
+private:
+  RungeKuttaRayBending::Result solve(RungeKuttaRayBending &aSolver, Vector const& aDirection) const;
+  // Fills only the parameters and the speed.
+  Candidate measure(RungeKuttaRayBending::Parameters const& aParameters, std::vector<RungeKuttaRayBending::Result> &aHits) const;
+  void compare(std::vector<RungeKuttaRayBending::Result> const& aHits, std::vector<RungeKuttaRayBending::Result> const& aAgainst, Candidate &aCandidate) const;
+  void sampleDirections(uint32_t const aRayCount);
+};
+
+#endif // SOLVERTUNING_H
@@ -0,0 +1,54 @@
+#include "TaskGraph.h"
+#include <stdexcept>
+
+
+TaskGraph::Id TaskGraph::add(std::function<void()> aTask, std::vector<Id> const& aDependencies) {
+  Id result = mNodes.size();
+  for(auto dependency : aDependencies) {
+    if(dependency != csNone && dependency >= result) {
+      throw std::invalid_argument("TaskGraph: dependencies must be added first.");
+    }
+    else {} // nothing to do
+  }
+  mNodes.push_back(Node{std::move(aTask), aDependencies});
+  return result;
+}
+
+void TaskGraph::run(ThreadPool &aPool) {
+  mDone.assign(mNodes.size(), 0u);
+  mFailed = false;
+  aPool.run(mNodes.size(), 1u, [this](uint32_t const, uint64_t const aBegin, uint64_t const aEnd) {
+    for(uint64_t i = aBegin; i < aEnd; ++i) {
+      auto const& node = mNodes[i];
+      {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mFinished.wait(lock, [this, &node] {
+          bool ready = true;
+          for(auto dependency : node.mDependencies) {
+            ready = ready && (dependency == csNone || mDone[dependency] != 0u);
+          }
+          return ready || mFailed;
+        });
+        if(mFailed) {
+          mDone[i] = 1u;
+          mFinished.notify_all();
+          continue;
+        }
+        else {} // nothing to do
+      }
+      try {
+        node.mTask();
+      }
+      catch(...) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFailed = true;
+        mDone[i] = 1u;
+        mFinished.notify_all();
+        throw;
+      }
+      std::lock_guard<std::mutex> lock(mMutex);
+      mDone[i] = 1u;
+      mFinished.notify_all();
+    }
+  });
+}
@@ -0,0 +1,39 @@
+#ifndef TASKGRAPH_H
+#define TASKGRAPH_H
+
+#include "ThreadPool.h"
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+
+// Tasks with dependencies run on the threads of a ThreadPool. A task can only depend on tasks added before it,
+// so the ids are a topological order. The threads take the tasks in this order and wait for their dependencies,
+// so independent tasks overlap as far as the pool has threads, and a single thread runs them one by one.
+class TaskGraph final {
+public:
+  using Id = uint32_t;
+  static constexpr Id csNone = ~0u;  // Ignored as dependency, stands for a task not added.
+
+private:
+  struct Node {
+    std::function<void()> mTask;
+    std::vector<Id>       mDependencies;
+  };
+
+  std::vector<Node>       mNodes;
+  std::vector<uint8_t>    mDone;
+  bool                    mFailed = false;  // A task threw, the ones not yet started are skipped.
+  std::mutex              mMutex;
+  std::condition_variable mFinished;
+
+public:
+  Id add(std::function<void()> aTask, std::vector<Id> const& aDependencies = {});
+
+  // Returns when all tasks are done. Rethrows the first exception of the tasks.
+  void run(ThreadPool &aPool);
+};
+
+#endif // TASKGRAPH_H
@@ -0,0 +1,75 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+
+ThreadPool::ThreadPool(uint32_t const aThreadCount) {
+  uint32_t count = (aThreadCount == 0u ? std::max(1u, std::thread::hardware_concurrency()) : aThreadCount);
+  for(uint32_t i = 0u; i < count; ++i) {
+    mThreads.emplace_back([this, i] { work(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStop = true;
+  }
+  mWake.notify_all();
+  for(auto &thread : mThreads) {
+    thread.join();
+  }
+}
+
+void ThreadPool::run(uint64_t const aCount, uint64_t const aChunk, Task const& aTask) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  mTask = &aTask;
+  mCount = aCount;
+  mChunk = std::max<uint64_t>(1u, aChunk);
+  mNext = 0u;
+  mBusy = mThreads.size();
+  mException = nullptr;
+  ++mGeneration;
+  mWake.notify_all();
+  mDone.wait(lock, [this] { return mBusy == 0u; });
+  mTask = nullptr;
+  if(mException) {
+    std::rethrow_exception(mException);
+  }
+  else {} // nothing to do
+}
+
+void ThreadPool::work(uint32_t const aThread) {
+  uint64_t generation = 0u;
+  while(true) {
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mWake.wait(lock, [this, generation] { return mStop || mGeneration != generation; });
+      if(mStop) {
+        break;
+      }
+      else {} // nothing to do
+      generation = mGeneration;
+    }
+    try {
+      for(uint64_t begin = mNext.fetch_add(mChunk); begin < mCount; begin = mNext.fetch_add(mChunk)) {
+        (*mTask)(aThread, begin, std::min(begin + mChunk, mCount));
+      }
+    }
+    catch(...) {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if(!mException) {
+        mException = std::current_exception();
+      }
+      else {} // nothing to do
+      mNext = mCount;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      --mBusy;
+      if(mBusy == 0u) {
+        mDone.notify_one();
+      }
+      else {} // nothing to do
+    }
+  }
+}
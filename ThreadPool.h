@@ -0,0 +1,54 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Persistent worker threads processing index ranges. The ranges are taken in chunks from a shared counter,
+// so faster threads take more of them. Only one run at a time, and not from inside a task.
+class ThreadPool final {
+public:
+  // Called with the index of the worker thread in [0, getThreadCount()) and an index range [aBegin, aEnd).
+  using Task = std::function<void(uint32_t const aThread, uint64_t const aBegin, uint64_t const aEnd)>;
+
+private:
+  std::vector<std::thread>  mThreads;
+  std::mutex                mMutex;
+  std::condition_variable   mWake;
+  std::condition_variable   mDone;
+  Task const               *mTask = nullptr;
+  uint64_t                  mCount = 0u;
+  uint64_t                  mChunk = 1u;
+  std::atomic<uint64_t>     mNext{0u};
+  uint32_t                  mBusy = 0u;
+  uint64_t                  mGeneration = 0u;
+  bool                      mStop = false;
+  std::exception_ptr        mException;  // The first one thrown by a task in this run.
+
+public:
+  // 0 means all CPUs.
+  explicit ThreadPool(uint32_t const aThreadCount);
+  ~ThreadPool();
+  ThreadPool(ThreadPool const&) = delete;
+  ThreadPool(ThreadPool &&) = delete;
+  ThreadPool& operator=(ThreadPool const&) = delete;
+  ThreadPool& operator=(ThreadPool &&) = delete;
+
+  uint32_t getThreadCount() const { return mThreads.size(); }
+
+  // Calls aTask for chunks of at most aChunk indices until [0, aCount) is covered, and returns when all are done.
+  // Rethrows the first exception of the tasks, the remaining chunks are skipped then.
+  void run(uint64_t const aCount, uint64_t const aChunk, Task const& aTask);
+
+private:
+  void work(uint32_t const aThread);
+};
+
+#endif // THREADPOOL_H
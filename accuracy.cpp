@@ -0,0 +1,139 @@
+#include "SolverTuning.h"
+#include "CLI.hpp"
+#include "png.hpp"
+#include <iostream>
+#include <iomanip>
+
+
+void print(SolverTuning::Candidate const& aCandidate) {
+  auto const& parameters = aCandidate.mParameters;
+  std::cout << std::setw(26) << std::left << getStepperName(parameters.mStepper) << std::right
+            << std::setw(8) << std::setprecision(0) << std::scientific << parameters.mTolAbs
+            << std::setw(7) << std::setprecision(1) << std::fixed << parameters.mStepMax
+            << std::setw(17) << std::setprecision(12) << parameters.mMaxCosDirChange
+            << std::setw(12) << std::setprecision(4) << aCandidate.mError95
+            << std::setw(12) << std::setprecision(4) << aCandidate.mErrorMax
+            << std::setw(10) << std::setprecision(4) << aCandidate.mMismatchRatio
+            << std::setw(12) << std::setprecision(0) << aCandidate.mRaysPerSecond << '\n';
+}
+
+void printHeader() {
+  std::cout << "stepper                    tolerance stepMax maxCosDirChange  error95(px) errorMax(px) mismatch      rays/s\n";
+}
+
+int main(int aArgc, char **aArgv) {
+  SolverTuning::Scene scene;
+  RungeKuttaRayBending::Parameters base;
+
+  CLI::App opt{"Usage"};
+  bool all = false;
+  opt.add_option("--all", all, "print all candidates, not only the Pareto frontier (true, false) [false]");
+  std::string nameBase = "water";
+  opt.add_option("--base", nameBase, "base type (conventional / porous / water) [water]");
+  scene.mBullLift = 0.0;
+  opt.add_option("--bullLift", scene.mBullLift, "lift of bulletin from ground (m) [0.0]");
+  scene.mCamCenter = 1.1;
+  opt.add_option("--camCenter", scene.mCamCenter, "height of camera center (m) [1.1]");
+  scene.mDist = 1000.0;
+  opt.add_option("--dist", scene.mDist, "distance of bulletin and camera [1000]");
+  std::string nameForm = "round";
+  opt.add_option("--earthForm", nameForm, "Earth form (flat / round) [round]");
+  double earthRadius = 6371.0;
+  opt.add_option("--earthRadius", earthRadius, "Earth radius (km) [6371.0]");
+  bool mixed = false;
+  opt.add_option("--mixed", mixed, "also print the hit errors of the Pareto frontier in mixed precision compared to double (true, false) [false]");
+  scene.mHeight = 9.0;
+  opt.add_option("--height", scene.mHeight, "height of bulletin (m) [9.0]  its width will be calculated");
+  std::string nameIn = "monoscopeRca.png";
+  opt.add_option("--nameIn", nameIn, "input filename to know the billboard pixel size [monoscopeRca.png]");
+  uint32_t rayCount = 200u;
+  opt.add_option("--rays", rayCount, "size of the ray set (count) [200]");
+  double targetError = 0.5;
+  opt.add_option("--targetError", targetError, "maximal 95th percentile of hit errors (billboard pixels) [0.5]");
+  double targetMismatch = 0.01;
+  opt.add_option("--targetMismatch", targetMismatch, "maximal ratio of rays hitting something else than the reference [0.01]");
+  scene.mTempAmb = std::nan("");
+  opt.add_option("--tempAmb", scene.mTempAmb, "ambient temperature (Celsius) [20 for conventional, 38.5 for porous, 10 for water]");
+  scene.mTempBase = 13.0;
+  opt.add_option("--tempBase", scene.mTempBase, "base temperature, only for water (Celsius) [13]");
+  CLI11_PARSE(opt, aArgc, aArgv);
+
+  if(nameBase == "conventional") {
+    scene.mModel = Eikonal::Model::cConventional;
+  }
+  else if(nameBase == "porous") {
+    scene.mModel = Eikonal::Model::cPorous;
+  }
+  else if(nameBase == "water") {
+    scene.mModel = Eikonal::Model::cWater;
+  }
+  else {
+    std::cerr << "Illegal base value: " << nameBase << '\n';
+    return 1;
+  }
+
+  if(nameForm == "flat") {
+    scene.mEarthForm = Eikonal::EarthForm::cFlat;
+  }
+  else if(nameForm == "round") {
+    scene.mEarthForm = Eikonal::EarthForm::cRound;
+  }
+  else {
+    std::cerr << "Illegal Earth form value: " << nameForm << '\n';
+    return 1;
+  }
+
+  if(std::isnan(scene.mTempAmb)) {
+    scene.mTempAmb = (scene.mModel == Eikonal::Model::cConventional ? 20.0 :
+                     (scene.mModel == Eikonal::Model::cPorous ? 38.5 : 10.0));
+  }
+  else {} // nothing to do
+  scene.mTempAmbMin = scene.mTempAmbMax = scene.mTempAmb;
+  scene.mEarthRadius = earthRadius * 1000.0;
+  png::image<png::gray_pixel> billboard(nameIn);
+  scene.mTexelSize = scene.mHeight / billboard.get_height();
+  scene.mWidth = scene.mTexelSize * billboard.get_width();
+
+  base.mDistAlongRay = scene.mDist * 2.0;
+  base.mStep1        = 0.01;
+  base.mStepMin      = 1e-4;
+
+  SolverTuning tuning(scene, base, rayCount);
+  std::vector<SolverTuning::Candidate> candidates;
+  for(auto const& parameters : SolverTuning::getCandidateGrid(base)) {
+    candidates.push_back(tuning.evaluate(parameters));
+  }
+
+  if(all) {
+    std::cout << "All candidates:\n";
+    printHeader();
+    for(auto const& candidate : candidates) {
+      print(candidate);
+    }
+    std::cout << '\n';
+  }
+  else {} // nothing to do
+  std::cout << "Pareto frontier:\n";
+  printHeader();
+  for(auto const& candidate : SolverTuning::getParetoFrontier(candidates)) {
+    print(candidate);
+  }
+  auto cheapest = SolverTuning::getCheapest(candidates, targetError, targetMismatch);
+  if(cheapest != nullptr) {
+    std::cout << "\nCheapest meeting the targets:\n";
+    printHeader();
+    print(*cheapest);
+  }
+  else {
+    std::cout << "\nNo candidate meets the targets.\n";
+  }
+  if(mixed) {
+    std::cout << "\nPareto frontier in mixed precision, errors compared to double:\n";
+    printHeader();
+    for(auto const& candidate : SolverTuning::getParetoFrontier(candidates)) {
+      print(tuning.evaluateMixed(candidate.mParameters));
+    }
+  }
+  else {} // nothing to do
+  return 0;
+}
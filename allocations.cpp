@@ -0,0 +1,117 @@
+#include "simpleRaytracer.h"
+#include "mathUtil.h"
+#include "CLI.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+
+// Heap allocations of the whole program. The global operator new can be replaced only once in a program,
+// so it is done here and not in the library.
+std::atomic<uint64_t> gAllocationCount{0u};
+
+void* operator new(std::size_t aSize) {
+  gAllocationCount.fetch_add(1u, std::memory_order_relaxed);
+  void *result = std::malloc(aSize == 0u ? 1u : aSize);
+  if(result == nullptr) {
+    throw std::bad_alloc();
+  }
+  else {} // nothing to do
+  return result;
+}
+
+void operator delete(void *aPointer) noexcept {
+  std::free(aPointer);
+}
+
+void operator delete(void *aPointer, std::size_t) noexcept {
+  std::free(aPointer);
+}
+
+// Keeps the compiler from optimizing the checked calls away.
+volatile double gSink;
+
+// After setting up the media, tracing rays like Image::tracePixel with step hints in double and mixed precision,
+// also past a nearer object like with --object, searching with binarySearch and evaluating PolynomApprox must
+// not allocate, because allocator contention hurts with many threads. Returns false and tells about it if they do.
+bool checkAllocations(RungeKuttaRayBending::Parameters const& aParameters, png::image<png::gray_pixel> const& aBillboard) {
+  uint32_t const cCount = 1000u;
+  double const cEarthRadius = 6371000.0;
+  double const cDist = 1000.0;
+  double const cHeight = 9.0;
+  double const cCamCenter = 1.1;
+  double const cOccluderDist = 300.0;
+  double const cOccluderLift = 0.5;
+  double const cOccluderHeight = 0.6;
+  Object object(aBillboard, cDist, 0.0, cHeight, cEarthRadius);
+  Medium medium(aParameters, Eikonal::EarthForm::cRound, cEarthRadius, Eikonal::Model::cWater, 10.0, 8.0, 14.0, 13.0, object);
+  Medium mixed(medium, 1.0, RungeKuttaRayBending::Precision::cMixed);
+  // The rays below pass above, through and below the occluder, so Medium::traceObjects stops and goes on.
+  Object occluder(aBillboard, cOccluderDist, cOccluderLift, cOccluderHeight, cEarthRadius);
+  Medium scene(aParameters, Eikonal::EarthForm::cRound, cEarthRadius, Eikonal::Model::cWater, 10.0, 8.0, 14.0, 13.0, object, { &occluder });
+  std::vector<double> samplesX;
+  std::vector<double> samplesY;
+  for(uint32_t i = 0u; i < 32u; ++i) {
+    samplesX.push_back(i / 32.0);
+    samplesY.push_back(std::exp(-samplesX.back()));
+  }
+  PolynomApprox approx(samplesY, { PolynomApprox::Var{ samplesX, 3u } });
+  Ray ray;
+  ray.mStart = Vertex(0.0, cCamCenter, 0.0);
+  RungeKuttaRayBending::Result hit;
+  RungeKuttaRayBending::StepSchedule schedule;
+  uint64_t sum = 0u;
+
+  auto before = gAllocationCount.load();
+  for(uint32_t i = 0u; i < cCount; ++i) {
+    auto angle = -0.002 + 0.006 * i / cCount;
+    ray.mDirection = Vector(std::cos(angle), std::sin(angle), 0.0);
+    sum += medium.trace(ray, hit, RungeKuttaRayBending::csMaxStep, schedule.mCount > 0u ? &schedule : nullptr);
+    if(hit.mValid) {
+      schedule = hit.mSchedule;
+    }
+    else {} // nothing to do
+    sum += mixed.trace(ray, hit);
+    sum += (medium.hits(ray) ? 1u : 0u);
+    sum += scene.trace(ray, hit);
+  }
+  std::array<double, 8u> bigCapture{};
+  sum += static_cast<uint64_t>(binarySearch(-0.05, 0.0, 1e-9, [&medium, &ray, bigCapture](double const aAngle) {
+    Ray search = ray;
+    search.mDirection = Vector(std::cos(aAngle + bigCapture[0]), std::sin(aAngle), 0.0);
+    return medium.hits(search);
+  }) * 1e6);
+  sum += static_cast<uint64_t>(approx.eval({ 0.5 }) + approx.eval(0.25));
+  auto allocations = gAllocationCount.load() - before;
+  gSink = sum;
+
+  if(allocations > 0u) {
+    std::cerr << "Allocation check failed: " << allocations << " heap allocations in " << cCount << " rays after set-up.\n";
+  }
+  else {} // nothing to do
+  return allocations == 0u;
+}
+
+int main(int aArgc, char **aArgv) {
+  RungeKuttaRayBending::Parameters paraRk;
+
+  CLI::App opt{"Usage"};
+  std::string nameIn = "monoscopeRca.png";
+  opt.add_option("--nameIn", nameIn, "billboard filename [monoscopeRca.png]");
+  CLI11_PARSE(opt, aArgc, aArgv);
+
+  paraRk.mStepper         = StepperType::cRungeKuttaFehlberg45;
+  paraRk.mDistAlongRay    = 2000.0;
+  paraRk.mTolAbs          = 0.001;
+  paraRk.mTolRel          = 0.001;
+  paraRk.mStep1           = 0.01;
+  paraRk.mStepMin         = 1e-4;
+  paraRk.mStepMax         = 55.5;
+  paraRk.mMaxCosDirChange = 0.99999999999;
+
+  png::image<png::gray_pixel> billboard(nameIn);
+  bool allocationFree = checkAllocations(paraRk, billboard);
+  std::cout << (allocationFree ? "PASSED" : "FAILED") << '\n';
+  return allocationFree ? 0 : 1;
+}
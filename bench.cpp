@@ -0,0 +1,283 @@
+#include "simpleRaytracer.h"
+#include "mathUtil.h"
+#include "CLI.hpp"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+
+// Forwards to Eikonal and counts the right hand side evaluations of the solver.
+class CountingEikonal final {
+public:
+  static constexpr uint32_t csNvar = Eikonal::csNvar;
+  using Variables                  = Eikonal::Variables;
+
+private:
+  Eikonal const&   mEikonal;
+  mutable uint64_t mCount = 0u;
+
+public:
+  CountingEikonal(Eikonal const& aEikonal) : mEikonal(aEikonal) {}
+
+  uint64_t getCount() const { return mCount; }
+  void     reset()          { mCount = 0u; }
+
+  int differentials(double const aT, const double aY[], double aDydt[]) const {
+    ++mCount;
+    return mEikonal.differentials(aT, aY, aDydt);
+  }
+
+  int jacobian(double const aT, const double aY[], double *aDfdy, double aDfdt[]) const {
+    return mEikonal.jacobian(aT, aY, aDfdy, aDfdt);
+  }
+};
+
+struct Measurement {
+  std::string mName;
+  double      mNsPerOp;
+  double      mRhsPerRay;     // NaN if not applicable
+  double      mRaysPerSecond; // NaN if not applicable
+};
+
+// Keeps the compiler from optimizing the measured calls away.
+volatile double gSink;
+
+// Returns the fastest of aRepeat runs in ns per call, which is the most reproducible figure.
+template <typename tFunction>
+double measure(uint32_t const aRepeat, uint32_t const aCount, tFunction aFunction) {
+  double result = std::numeric_limits<double>::max();
+  for(uint32_t r = 0u; r <= aRepeat; ++r) {   // The first one is warmup.
+    double sink = 0.0;
+    auto begin = std::chrono::steady_clock::now();
+    for(uint32_t i = 0u; i < aCount; ++i) {
+      sink += aFunction(i);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+    gSink = sink;
+    if(r > 0u) {
+      result = std::min(result, elapsed.count() / aCount);
+    }
+    else {} // nothing to do
+  }
+  return result;
+}
+
+std::string getModelName(Eikonal::Model const aModel) {
+  return aModel == Eikonal::Model::cConventional ? "conventional" : (aModel == Eikonal::Model::cPorous ? "porous" : "water");
+}
+
+double getDefaultTempAmb(Eikonal::Model const aModel) {
+  return aModel == Eikonal::Model::cConventional ? 20.0 : (aModel == Eikonal::Model::cPorous ? 38.5 : 10.0);
+}
+
+void benchEikonal(uint32_t const aRepeat, std::vector<Measurement> &aResults) {
+  uint32_t const cCount = 1000000u;
+  double const cEarthRadius = 6371000.0;
+  for(auto model : { Eikonal::Model::cConventional, Eikonal::Model::cPorous, Eikonal::Model::cWater }) {
+    for(auto form : { Eikonal::EarthForm::cFlat, Eikonal::EarthForm::cRound }) {
+      Eikonal eikonal(form, cEarthRadius, model, getDefaultTempAmb(model), 8.0, 14.0, 13.0);
+      auto base = (form == Eikonal::EarthForm::cFlat ? 0.0 : cEarthRadius);
+      double y[Eikonal::csNvar] = { 500.0, base + 0.1, 0.0, 1.0 / Eikonal::csC, 0.0, 0.0 };
+      double dydt[Eikonal::csNvar];
+      auto ns = measure(aRepeat, cCount, [&eikonal, &y, &dydt, base](uint32_t const aI) {
+        y[1] = base + 0.01 + 1e-6 * (aI & 0xffffu);
+        eikonal.differentials(0.0, y, dydt);
+        return dydt[4];
+      });
+      aResults.push_back({ "Eikonal::differentials/" + getModelName(model) + '/' + (form == Eikonal::EarthForm::cFlat ? "flat" : "round"),
+                           ns, std::nan(""), std::nan("") });
+    }
+    Eikonal eikonal(Eikonal::EarthForm::cFlat, cEarthRadius, model, getDefaultTempAmb(model), 8.0, 14.0, 13.0);
+    auto height = [](uint32_t const aI) { return 0.01 + 1e-6 * (aI & 0xffffu); };
+    aResults.push_back({ "Eikonal::getRefract/" + getModelName(model),
+                         measure(aRepeat, cCount, [&eikonal, &height](uint32_t const aI) { return eikonal.getRefract(height(aI)); }), std::nan(""), std::nan("") });
+    aResults.push_back({ "Eikonal::getRefractDiff/" + getModelName(model),
+                         measure(aRepeat, cCount, [&eikonal, &height](uint32_t const aI) { return eikonal.getRefractDiff(height(aI)); }), std::nan(""), std::nan("") });
+    aResults.push_back({ "Eikonal::getRefractDiff2/" + getModelName(model),
+                         measure(aRepeat, cCount, [&eikonal, &height](uint32_t const aI) { return eikonal.getRefractDiff2(height(aI)); }), std::nan(""), std::nan("") });
+  }
+}
+
+// Rays from the camera over water with round Earth like in main, the grazing one just above the critical angle.
+void benchSolve(uint32_t const aRepeat, RungeKuttaRayBending::Parameters const& aParameters, std::vector<Measurement> &aResults) {
+  uint32_t const cCount = 100u;
+  double const cEarthRadius = 6371000.0;
+  double const cCamCenter = 1.1;
+  double const cDist = 1000.0;
+  Eikonal eikonal(Eikonal::EarthForm::cRound, cEarthRadius, Eikonal::Model::cWater, 10.0, 8.0, 14.0, 13.0);
+  CountingEikonal counting(eikonal);
+  OdeSolverGsl<CountingEikonal> solver(aParameters.mStepper, 0.0, aParameters.mDistAlongRay, aParameters.mTolAbs, aParameters.mTolRel,
+                                       aParameters.mStep1, aParameters.mStepMin, aParameters.mStepMax, counting);
+  auto solve = [&](double const aAngle) {
+    CountingEikonal::Variables start;
+    auto slowness = eikonal.getSlowness(cCamCenter);
+    start[0u] = 0.0;
+    start[1u] = cCamCenter + cEarthRadius;
+    start[2u] = 0.0;
+    start[3u] = std::cos(aAngle) * slowness;
+    start[4u] = std::sin(aAngle) * slowness;
+    start[5u] = 0.0;
+    return solver.solve(start, [cDist](double const, CountingEikonal::Variables const& aY){ return aY[0] >= cDist; },
+                       [&aParameters](CountingEikonal::Variables const& aYprev, CountingEikonal::Variables const& aYnow) {
+                         Vector dirPrev(aYprev[3u], aYprev[4u], aYprev[5u]);
+                         Vector dir(aYnow[3u], aYnow[4u], aYnow[5u]);
+                         return dir.dot(dirPrev) / dir.norm() / dirPrev.norm() < aParameters.mMaxCosDirChange;
+                       });
+  };
+  auto critical = binarySearch(-0.05, 0.0, 1e-9, [&solve](double const aAngle) { return solve(aAngle).mValid; }) + 1e-9;
+  for(auto [name, angle] : { std::make_pair("grazing", critical), std::make_pair("normal", 0.002), std::make_pair("ground", -0.05) }) {
+    counting.reset();
+    auto ns = measure(aRepeat, cCount, [&solve, angle = angle](uint32_t) { return solve(angle).mValue[1]; });
+    auto rhs = static_cast<double>(counting.getCount()) / (cCount * (aRepeat + 1u));
+    aResults.push_back({ std::string("OdeSolverGsl::solve/") + name, ns, rhs, 1e9 / ns });
+  }
+}
+
+void benchScene(uint32_t const aRepeat, RungeKuttaRayBending::Parameters const& aParameters, Image::Parameters const& aParaIm,
+                png::image<png::gray_pixel> const& aBillboard, std::string const& aNameOut, std::vector<Measurement> &aResults) {
+  double const cEarthRadius = 6371000.0;
+  double const cDist = 1000.0;
+  double const cHeight = 9.0;
+  Object object(aBillboard, cDist, 0.0, cHeight, cEarthRadius);
+  Medium medium(aParameters, Eikonal::EarthForm::cRound, cEarthRadius, Eikonal::Model::cWater, 10.0, 8.0, 14.0, 13.0, object);
+
+  std::mt19937 generator(1u);
+  std::uniform_real_distribution<double> distY(0.0, cHeight);
+  std::uniform_real_distribution<double> distZ(-cHeight / 2.0, cHeight / 2.0);
+  std::vector<Vertex> hits;
+  for(uint32_t i = 0u; i < 65536u; ++i) {
+    hits.emplace_back(cDist, distY(generator), distZ(generator));
+  }
+  aResults.push_back({ "Object::getPixel", measure(aRepeat, 1000000u, [&object, &hits](uint32_t const aI) {
+    return object.getPixel(hits[aI & 0xffffu]);
+  }), std::nan(""), std::nan("") });
+
+  Ray ray;
+  ray.mStart = Vertex(0.0, aParaIm.mCamCenter, 0.0);
+  RungeKuttaRayBending::Result hit;
+  auto ns = measure(aRepeat, 100u, [&medium, &ray, &hit](uint32_t const aI) {
+    auto angle = 0.001 + 1e-5 * (aI % 10u);
+    ray.mDirection = Vector(std::cos(angle), std::sin(angle), 0.0);
+    return medium.trace(ray, hit);
+  });
+  aResults.push_back({ "Medium::trace", ns, std::nan(""), 1e9 / ns });
+
+  double seconds = std::numeric_limits<double>::max();
+  uint64_t rays = 0u;
+  for(uint32_t r = 0u; r < std::max(1u, aRepeat / 2u); ++r) {
+    Image image(aParaIm, medium);
+    image.process(png::image<png::gray_pixel>(), aNameOut.c_str(), "");
+    if(image.getMirageSeconds() < seconds) {
+      seconds = image.getMirageSeconds();
+      rays = image.getMirageRayCount();
+    }
+    else {} // nothing to do
+  }
+  aResults.push_back({ "Image::calculateMirage", seconds * 1e9 / rays, std::nan(""), rays / seconds });
+}
+
+void benchPolynom(uint32_t const aRepeat, std::vector<Measurement> &aResults) {
+  uint32_t const cSamples = 32u;
+  std::vector<double> x;
+  std::vector<double> xx;
+  std::vector<double> yy;
+  std::vector<double> y1;
+  std::vector<double> y2;
+  for(uint32_t i = 0u; i < cSamples; ++i) {
+    for(uint32_t j = 0u; j < cSamples; ++j) {
+      xx.push_back(i / static_cast<double>(cSamples));
+      yy.push_back(j / static_cast<double>(cSamples));
+      y2.push_back(std::exp(-xx.back()) * std::cos(yy.back()));
+    }
+    x.push_back(i / static_cast<double>(cSamples));
+    y1.push_back(std::exp(-x.back()));
+  }
+  PolynomApprox approx1(y1, { PolynomApprox::Var{ x, 5u } });
+  PolynomApprox approx2(y2, { PolynomApprox::Var{ xx, 5u }, PolynomApprox::Var{ yy, 5u } });
+  aResults.push_back({ "PolynomApprox::eval/1", measure(aRepeat, 1000000u, [&approx1](uint32_t const aI) {
+    return approx1.eval((aI & 0xffu) / 256.0);
+  }), std::nan(""), std::nan("") });
+  aResults.push_back({ "PolynomApprox::eval/2", measure(aRepeat, 1000000u, [&approx2](uint32_t const aI) {
+    return approx2.eval({ (aI & 0xffu) / 256.0, (aI >> 8u & 0xffu) / 256.0 });
+  }), std::nan(""), std::nan("") });
+}
+
+void writeJson(std::ostream &aOut, std::vector<Measurement> const& aResults) {
+  auto number = [&aOut](char const * const aName, double const aValue) {
+    if(!std::isnan(aValue)) {
+      aOut << ", \"" << aName << "\": " << std::setprecision(6) << aValue;
+    }
+    else {} // nothing to do
+  };
+  aOut << "{\n  \"results\": [\n";
+  for(uint32_t i = 0u; i < aResults.size(); ++i) {
+    aOut << "    { \"name\": \"" << aResults[i].mName << '"';
+    number("nsPerOp", aResults[i].mNsPerOp);
+    number("rhsPerRay", aResults[i].mRhsPerRay);
+    number("raysPerSecond", aResults[i].mRaysPerSecond);
+    aOut << (i + 1u < aResults.size() ? " },\n" : " }\n");
+  }
+  aOut << "  ]\n}\n";
+}
+
+int main(int aArgc, char **aArgv) {
+  RungeKuttaRayBending::Parameters paraRk;
+  Image::Parameters paraIm;
+
+  CLI::App opt{"Usage"};
+  std::string nameIn = "monoscopeRca.png";
+  opt.add_option("--nameIn", nameIn, "billboard filename of the reference scene [monoscopeRca.png]");
+  std::string nameJson = "";
+  opt.add_option("--nameJson", nameJson, "output filename for the JSON results, stdout if empty []");
+  std::string nameOut = "bench.png";
+  opt.add_option("--nameOut", nameOut, "output filename of the reference scene [bench.png]");
+  uint32_t repeat = 5u;
+  opt.add_option("--repeat", repeat, "measurement repetitions, the fastest counts (count) [5]");
+  paraIm.mResolutionX = 300u;
+  opt.add_option("--resolution", paraIm.mResolutionX, "film resolution of the reference scene in X direction (pixel) [300]");
+  paraIm.mThreadCount = 1u;
+  opt.add_option("--threads", paraIm.mThreadCount, "threads for the reference scene, 0 means all CPUs (count) [1]");
+  CLI11_PARSE(opt, aArgc, aArgv);
+
+  paraRk.mStepper         = StepperType::cRungeKuttaFehlberg45;
+  paraRk.mDistAlongRay    = 2000.0;
+  paraRk.mTolAbs          = 0.001;
+  paraRk.mTolRel          = 0.001;
+  paraRk.mStep1           = 0.01;
+  paraRk.mStepMin         = 1e-4;
+  paraRk.mStepMax         = 55.5;
+  paraRk.mMaxCosDirChange = 0.99999999999;
+  paraIm.mRestrictCpu     = 0u;
+  paraIm.mCamCenter       = 1.1;
+  paraIm.mTilt            = 0.0;
+  paraIm.mBorderFactor    = 0.05;
+  paraIm.mSubsample       = 2u;
+  paraIm.mMarkIndent      = 0.9;
+  paraIm.mMarkAcross      = false;
+  paraIm.mMarkTriple      = false;
+  paraIm.mOutputFormat    = Image::OutputFormat::cIndexed8;
+  paraIm.mRetainHits      = false;
+  paraIm.mTimeBudget      = 0.0;
+  paraIm.mProfile         = false;
+  paraIm.mStepHints       = true;
+  paraIm.mSymmetry        = true;
+  paraIm.mTolLoose        = 1.0;
+  paraIm.mPrecision       = RungeKuttaRayBending::Precision::cDouble;
+
+  png::image<png::gray_pixel> billboard(nameIn);
+  std::vector<Measurement> results;
+  benchEikonal(repeat, results);
+  benchPolynom(repeat, results);
+  benchSolve(repeat, paraRk, results);
+  benchScene(repeat, paraRk, paraIm, billboard, nameOut, results);
+
+  if(nameJson.empty()) {
+    writeJson(std::cout, results);
+  }
+  else {
+    std::ofstream out(nameJson);
+    writeJson(out, results);
+  }
+  return 0;
+}
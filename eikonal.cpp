@@ -2,6 +2,7 @@
 #include "3dGeomUtil.h"
 #include "OdeSolverGsl.h"
 #include "RungeKuttaRayBending.h"
+#include "BatchTracer.h"
 #include "mathUtil.h"
 #include "CLI.hpp"
 #include <iostream>
@@ -20,6 +21,7 @@ struct MoreParameters {
   double             mDist;
   uint32_t           mSamples;
   bool               mSilent;
+  uint32_t           mThreads;
 };
 
 RungeKuttaRayBending::Result comp1(RungeKuttaRayBending::Parameters const& aParameters, MoreParameters const& aMore) {
@@ -41,17 +43,28 @@ RungeKuttaRayBending::Result comp1(RungeKuttaRayBending::Parameters const& aPara
   return solution;
 }
 
-void comp(std::string const& aPrefix, RungeKuttaRayBending::Parameters const& aParameters, MoreParameters const& aMore, bool aNeedXd) {
+void comp(std::string const& aPrefix, BatchTracer &aTracer, MoreParameters const& aMore, bool aNeedXd) {
   std::vector<Vertex> stuff;
   std::ofstream out(aPrefix + "values.txt");
   auto end = aMore.mDist * (1.0 + 0.5 / aMore.mSamples);
-  auto more = aMore;
-  for(more.mDist = 0.0; more.mDist <= end; more.mDist += aMore.mDist / aMore.mSamples) {
-    RungeKuttaRayBending::Result solution = comp1(aParameters, more);
-    if(solution.mValid) {
-      stuff.push_back(solution.mValue);
-      out << std::setprecision(10) << solution.mValue[0] << '\t' << std::setprecision(10) << solution.mValue[1] << '\n';
+  Ray ray;
+  ray.mStart = Vertex(0.0, aMore.mCamCenter, 0.0);
+  ray.mDirection = Vector(std::cos(aMore.mDir / 180.0 * cgPi), std::sin(aMore.mDir / 180.0 * cgPi), 0.0);
+  std::vector<BatchTracer::Request> requests;
+  for(double dist = aMore.mDist / aMore.mSamples; dist <= end; dist += aMore.mDist / aMore.mSamples) {
+    requests.push_back({ ray, dist });
+  }
+  std::vector<BatchTracer::Outcome> outcomes;
+  aTracer.traceBatch(requests, outcomes, BatchTracer::Options());
+  stuff.push_back(ray.mStart);
+  for(auto const& outcome : outcomes) {
+    if(outcome.mStatus == BatchTracer::Status::cValid) {
+      stuff.push_back(outcome.mResult.mValue);
     }
+    else {} // nothing to do
+  }
+  for(auto const& point : stuff) {
+    out << std::setprecision(10) << point[0] << '\t' << std::setprecision(10) << point[1] << '\n';
   }
   if(!aMore.mSilent) {
     if(aNeedXd) {
@@ -119,6 +132,8 @@ std::tuple<CliResult, RungeKuttaRayBending::Parameters, MoreParameters, std::str
   opt.add_option("--tempAmb", more.mTempAmb, "ambient temperature (Celsius) [20 for conventional, 38.5 for porous, 10 for water]");
   more.mTempBase = 13.0;
   opt.add_option("--tempBase", more.mTempBase, "base temperature, only for water (Celsius) [13]");
+  more.mThreads = 0u;
+  opt.add_option("--threads", more.mThreads, "threads tracing the samples, 0 means all CPUs (count) [0]");
   parameters.mTolAbs = 0.001;
   opt.add_option("--tolAbs", parameters.mTolAbs, "absolute tolerance (m) [1e-3]");
   parameters.mTolRel = 0.001;
@@ -268,6 +283,7 @@ void dump(RungeKuttaRayBending::Parameters const& aParameters, MoreParameters co
     std::cout << "stepper type:                                     " << aNameStepper << ' ' << static_cast<int>(aParameters.mStepper) << '\n';
     std::cout << "ambient temperature (Celsius):              .  .  " << aMore.mTempAmb << '\n';
     std::cout << "base temperature, only for water (Celsius):       " << aMore.mTempBase << '\n';
+    std::cout << "threads tracing the samples:                      " << aMore.mThreads << '\n';
     std::cout << "absolute tolerance (m):                           " << aParameters.mTolAbs << '\n';
     std::cout << "relative tolerance (m):               .  .  .  .  " << aParameters.mTolRel << '\n';
   }
@@ -283,9 +299,11 @@ int main(int aArgc, char **aArgv) {
   if(valid) {
     double mirrorDirection = calculateMirrorDirection(parameters, more);
     dump(parameters, more, mirrorDirection, nameBase, nameForm, nameStepper);
-    comp("crit", parameters, more, true);
+    Eikonal eikonal(more.mEarthForm, more.mEarthRadius, more.mMode, more.mTempAmb, more.mTempAmb, more.mTempAmb, more.mTempBase);
+    BatchTracer tracer(parameters, eikonal, more.mThreads);
+    comp("crit", tracer, more, true);
     more.mDir = mirrorDirection;
-    comp("mirr", parameters, more, false);
+    comp("mirr", tracer, more, false);
   }
   else {
     if(result == CliResult::cOk) {
@@ -1,30 +1,905 @@
 #include "simpleRaytracer.h"
+#include "SolverTuning.h"
 #include "CLI.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <thread>
+#include <tuple>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
+extern char **environ;
+
+
+constexpr uint32_t cgAutotuneRays     = 100u;
+constexpr double   cgAutotuneMismatch = 0.01;
+
+
+// An object of --object, besides the billboard.
+struct SceneObject {
+  std::string                                        mName;
+  std::shared_ptr<png::image<png::gray_pixel> const> mImage;
+  double                                             mDist;
+  double                                             mLift;
+  double                                             mHeight;
+  double                                             mCenter;  // m, positive to the left
+};
+
+// Everything needed to render one frame. Temperatures may be NaN until resolved.
+struct Settings {
+  RungeKuttaRayBending::Parameters mParaRk;
+  Image::Parameters                mParaIm;
+  Eikonal::Model                   mBase;
+  Eikonal::EarthForm               mEarthForm;
+  double                           mEarthRadius;  // km
+  double                           mBullLift;
+  double                           mDist;
+  double                           mHeight;
+  double                           mTempAmb;
+  double                           mTempAmbMin;
+  double                           mTempAmbMax;
+  double                           mTempBase;
+  std::vector<SceneObject>         mObjects;
+};
+
+// What --tile asks for.
+enum class TileStep : uint8_t {
+  cNone    = 0u,
+  cPrepare = 1u,
+  cRender  = 2u,
+  cMerge   = 3u
+};
+
+// One axis of the --sweep grid.
+struct Sweep {
+  std::string                       mName;
+  std::function<double&(Settings&)> mAccess;
+  double                            mStart;
+  double                            mStep;
+  uint32_t                          mCount;
+};
+
+std::map<std::string, std::function<double&(Settings&)>> getSweepables() {
+  return {
+    { "borderFactor",    [](Settings &aS) -> double& { return aS.mParaIm.mBorderFactor; } },
+    { "bullLift",        [](Settings &aS) -> double& { return aS.mBullLift; } },
+    { "camCenter",       [](Settings &aS) -> double& { return aS.mParaIm.mCamCenter; } },
+    { "dist",            [](Settings &aS) -> double& { return aS.mDist; } },
+    { "earthRadius",     [](Settings &aS) -> double& { return aS.mEarthRadius; } },
+    { "height",          [](Settings &aS) -> double& { return aS.mHeight; } },
+    { "maxCosDirChange", [](Settings &aS) -> double& { return aS.mParaRk.mMaxCosDirChange; } },
+    { "step1",           [](Settings &aS) -> double& { return aS.mParaRk.mStep1; } },
+    { "stepMax",         [](Settings &aS) -> double& { return aS.mParaRk.mStepMax; } },
+    { "stepMin",         [](Settings &aS) -> double& { return aS.mParaRk.mStepMin; } },
+    { "tempAmb",         [](Settings &aS) -> double& { return aS.mTempAmb; } },
+    { "tempAmbMax",      [](Settings &aS) -> double& { return aS.mTempAmbMax; } },
+    { "tempAmbMin",      [](Settings &aS) -> double& { return aS.mTempAmbMin; } },
+    { "tempBase",        [](Settings &aS) -> double& { return aS.mTempBase; } },
+    { "tilt",            [](Settings &aS) -> double& { return aS.mParaIm.mTilt; } },
+    { "tolAbs",          [](Settings &aS) -> double& { return aS.mParaRk.mTolAbs; } },
+    { "tolRel",          [](Settings &aS) -> double& { return aS.mParaRk.mTolRel; } }
+  };
+}
+
+// Parses param=start:step:count, the leading -- of param is optional.
+bool parseSweep(std::string const& aText, Sweep &aSweep) {
+  auto equals = aText.find('=');
+  if(equals == std::string::npos) {
+    std::cerr << "Illegal sweep, missing '=': " << aText << '\n';
+    return false;
+  }
+  else {} // nothing to do
+  auto nameStart = (aText.compare(0u, 2u, "--") == 0 ? 2u : 0u);
+  aSweep.mName = aText.substr(nameStart, equals - nameStart);
+  auto sweepables = getSweepables();
+  auto found = sweepables.find(aSweep.mName);
+  if(found == sweepables.end()) {
+    std::cerr << "Illegal sweep parameter: " << aSweep.mName << '\n';
+    return false;
+  }
+  else {} // nothing to do
+  aSweep.mAccess = found->second;
+  char tail;
+  if(std::sscanf(aText.c_str() + equals + 1u, "%lf:%lf:%u%c", &aSweep.mStart, &aSweep.mStep, &aSweep.mCount, &tail) != 3 || aSweep.mCount == 0u) {
+    std::cerr << "Illegal sweep range, expected start:step:count: " << aText << '\n';
+    return false;
+  }
+  else {} // nothing to do
+  return true;
+}
+
+// Parses name,dist,lift,height,center and reads the image.
+bool parseObject(std::string const& aText, SceneObject &aObject) {
+  auto comma = aText.find(',');
+  char tail;
+  if(comma == std::string::npos ||
+     std::sscanf(aText.c_str() + comma + 1u, "%lf,%lf,%lf,%lf%c", &aObject.mDist, &aObject.mLift, &aObject.mHeight, &aObject.mCenter, &tail) != 4 ||
+     aObject.mDist <= 0.0 || aObject.mHeight <= 0.0) {
+    std::cerr << "Illegal object, expected name,dist,lift,height,center with positive distance and height: " << aText << '\n';
+    return false;
+  }
+  else {} // nothing to do
+  aObject.mName = aText.substr(0u, comma);
+  aObject.mImage = std::make_shared<png::image<png::gray_pixel>>(aObject.mName);
+  return true;
+}
+
+// Parses prepare, i/N or merge/N, empty means no tiling.
+bool parseTile(std::string const& aText, TileStep &aStep, uint32_t &aIndex, uint32_t &aCount) {
+  char tail;
+  aIndex = 0u;
+  aCount = 0u;
+  if(aText.empty()) {
+    aStep = TileStep::cNone;
+  }
+  else if(aText == "prepare") {
+    aStep = TileStep::cPrepare;
+  }
+  else if(std::sscanf(aText.c_str(), "merge/%u%c", &aCount, &tail) == 1 && aCount > 0u) {
+    aStep = TileStep::cMerge;
+  }
+  else if(std::sscanf(aText.c_str(), "%u/%u%c", &aIndex, &aCount, &tail) == 2 && aIndex < aCount) {
+    aStep = TileStep::cRender;
+  }
+  else {
+    std::cerr << "Illegal tile, expected prepare, i/N with i < N or merge/N: " << aText << '\n';
+    return false;
+  }
+  return true;
+}
+
+// Substitutes aIndex for the single %d, %3d or %03d in aPattern. Returns empty string for illegal patterns.
+std::string formatSeriesName(std::string const& aPattern, uint32_t const aIndex) {
+  std::string result;
+  auto percent = aPattern.find('%');
+  if(percent != std::string::npos && aPattern.find('%', percent + 1u) == std::string::npos) {
+    auto end = aPattern.find_first_not_of("0123456789", percent + 1u);
+    if(end != std::string::npos && aPattern[end] == 'd') {
+      char number[32];
+      std::snprintf(number, sizeof(number), aPattern.substr(percent, end - percent + 1u).c_str(), aIndex);
+      result = aPattern.substr(0u, percent) + number + aPattern.substr(end + 1u);
+    }
+    else {} // nothing to do
+  }
+  else {} // nothing to do
+  return result;
+}
+
+// Converts the textual options to enums in aSettings.
+bool interpret(std::string const& aNameBase, std::string const& aNameForm, std::string const& aNameFormat, std::string const& aNamePrecision,
+               std::string const& aNameStepper, Settings &aSettings) {
+  if(aNameBase == "conventional") {
+    aSettings.mBase = Eikonal::Model::cConventional;
+  }
+  else if(aNameBase == "porous") {
+    aSettings.mBase = Eikonal::Model::cPorous;
+  }
+  else if(aNameBase == "water") {
+    aSettings.mBase = Eikonal::Model::cWater;
+  }
+  else {
+    std::cerr << "Illegal base value: " << aNameBase << '\n';
+    return false;
+  }
+
+  if(aNameForm == "flat") {
+    aSettings.mEarthForm = Eikonal::EarthForm::cFlat;
+  }
+  else if(aNameForm == "round") {
+    aSettings.mEarthForm = Eikonal::EarthForm::cRound;
+  }
+  else {
+    std::cerr << "Illegal Earth form value: " << aNameForm << '\n';
+    return false;
+  }
+
+  if(aNameFormat == "png8") {
+    aSettings.mParaIm.mOutputFormat = Image::OutputFormat::cIndexed8;
+  }
+  else if(aNameFormat == "png16") {
+    aSettings.mParaIm.mOutputFormat = Image::OutputFormat::cGray16;
+  }
+  else if(aNameFormat == "float") {
+    aSettings.mParaIm.mOutputFormat = Image::OutputFormat::cFloat32;
+  }
+  else if(aNameFormat == "raw") {
+    aSettings.mParaIm.mOutputFormat = Image::OutputFormat::cRaw;
+  }
+  else {
+    std::cerr << "Illegal output format value: " << aNameFormat << '\n';
+    return false;
+  }
+
+  if(aNamePrecision == "double") {
+    aSettings.mParaIm.mPrecision = RungeKuttaRayBending::Precision::cDouble;
+  }
+  else if(aNamePrecision == "mixed") {
+    aSettings.mParaIm.mPrecision = RungeKuttaRayBending::Precision::cMixed;
+  }
+  else {
+    std::cerr << "Illegal precision value: " << aNamePrecision << '\n';
+    return false;
+  }
+
+  if(aNameStepper == "RungeKutta23") {
+    aSettings.mParaRk.mStepper = StepperType::cRungeKutta23;
+  }
+  else if(aNameStepper == "RungeKuttaClass4") {
+    aSettings.mParaRk.mStepper = StepperType::cRungeKuttaClass4;
+  }
+  else if(aNameStepper == "RungeKuttaFehlberg45") {
+    aSettings.mParaRk.mStepper = StepperType::cRungeKuttaFehlberg45;
+  }
+  else if(aNameStepper == "RungeKuttaCashKarp45") {
+    aSettings.mParaRk.mStepper = StepperType::cRungeKuttaCashKarp45;
+  }
+  else if(aNameStepper == "RungeKuttaPrinceDormand89") {
+    aSettings.mParaRk.mStepper = StepperType::cRungeKuttaPrinceDormand89;
+  }
+  else if(aNameStepper == "BulirschStoerBaderDeuflhard") {
+    aSettings.mParaRk.mStepper = StepperType::cBulirschStoerBaderDeuflhard;
+  }
+  else {
+    std::cerr << "Illegal stepper value: " << aNameStepper << '\n';
+    return false;
+  }
+  return true;
+}
+
+// Fills in defaults depending on other values and checks consistency.
+bool resolve(Settings &aSettings) {
+  if(std::isnan(aSettings.mTempAmb)) {
+    aSettings.mTempAmb = (aSettings.mBase == Eikonal::Model::cConventional ? 20.0 :
+                         (aSettings.mBase == Eikonal::Model::cPorous ? 38.5 : 10.0));
+  }
+  else {} // nothing to do
+
+  if(std::isnan(aSettings.mTempAmbMin)) {
+    aSettings.mTempAmbMin = aSettings.mTempBase - 5.0;
+  }
+  else {} // nothing to do
+
+  if(std::isnan(aSettings.mTempAmbMax)) {
+    aSettings.mTempAmbMax = aSettings.mTempBase + 1.0;
+  }
+  else {} // nothing to do
+
+  bool result = true;
+  if(aSettings.mTempAmb < aSettings.mTempAmbMin || aSettings.mTempAmb > aSettings.mTempAmbMax ||
+     aSettings.mTempBase < aSettings.mTempAmbMin || aSettings.mTempBase > aSettings.mTempAmbMax) {
+    std::cerr << "TempAmb and tempBase must be between tempAmbMin and tempAmbMax.\n";
+    result = false;
+  }
+  else {} // nothing to do
+
+  double farthest = aSettings.mDist;
+  for(auto const& object : aSettings.mObjects) {
+    farthest = std::max(farthest, object.mDist);
+  }
+  aSettings.mParaRk.mDistAlongRay = farthest * 2.0;
+  return result;
+}
+
+// Replaces the solver settings by the fastest ones meeting aTargetError on a ray sample of the scene. The result
+// is looked up in or stored to the cache file aNameCache.
+void tuneSolver(Settings &aSettings, png::image<png::gray_pixel> const& aBillboard, double const aTargetError, std::string const& aNameCache) {
+  SolverTuning::Scene scene;
+  scene.mEarthForm   = aSettings.mEarthForm;
+  scene.mEarthRadius = aSettings.mEarthRadius * 1000.0;
+  scene.mModel       = aSettings.mBase;
+  scene.mTempAmb     = aSettings.mTempAmb;
+  scene.mTempAmbMin  = aSettings.mTempAmbMin;
+  scene.mTempAmbMax  = aSettings.mTempAmbMax;
+  scene.mTempBase    = aSettings.mTempBase;
+  scene.mCamCenter   = aSettings.mParaIm.mCamCenter;
+  scene.mDist        = aSettings.mDist;
+  scene.mBullLift    = aSettings.mBullLift;
+  scene.mHeight      = aSettings.mHeight;
+  scene.mTexelSize   = aSettings.mHeight / aBillboard.get_height();
+  scene.mWidth       = scene.mTexelSize * aBillboard.get_width();
+  auto hash = SolverTuning::getHash(scene, aSettings.mParaRk, cgAutotuneRays, aTargetError, cgAutotuneMismatch);
+  auto cached = SolverTuning::loadCached(aNameCache, hash, aSettings.mParaRk);
+  char const * origin = "cached";
+  if(!cached) {
+    SolverTuning tuning(scene, aSettings.mParaRk, cgAutotuneRays);
+    auto best = tuning.tune(aSettings.mParaRk, aTargetError, cgAutotuneMismatch);
+    if(best) {
+      cached = best->mParameters;
+      SolverTuning::storeCached(aNameCache, hash, *cached);
+      origin = "searched";
+    }
+    else {} // nothing to do
+  }
+  else {} // nothing to do
+  if(cached) {
+    aSettings.mParaRk = *cached;
+    std::cerr << "Autotuned solver (" << origin << "), stepper tolAbs tolRel step1 stepMax maxCosDirChange: " << getStepperName(cached->mStepper)
+              << ' ' << cached->mTolAbs << ' ' << cached->mTolRel << ' ' << cached->mStep1 << ' ' << cached->mStepMax << ' ' << std::setprecision(17) << cached->mMaxCosDirChange << std::endl;
+  }
+  else {
+    std::cerr << "Autotune found no solver setting meeting the target error, keeping the given ones." << std::endl;
+  }
+}
+
+// Copies the solver settings tuneSolver may change, keeping the integration length and the rest of each frame.
+void copyTuned(RungeKuttaRayBending::Parameters const& aTuned, RungeKuttaRayBending::Parameters &aTarget) {
+  aTarget.mStepper         = aTuned.mStepper;
+  aTarget.mTolAbs          = aTuned.mTolAbs;
+  aTarget.mTolRel          = aTuned.mTolRel;
+  aTarget.mStep1           = aTuned.mStep1;
+  aTarget.mStepMax         = aTuned.mStepMax;
+  aTarget.mMaxCosDirChange = aTuned.mMaxCosDirChange;
+}
+
+// The billboard and the objects of --object with the medium tracing them.
+class Scene final {
+private:
+  std::vector<std::unique_ptr<Object>> mObjects;  // The billboard first.
+  std::unique_ptr<Medium>              mMedium;
+
+public:
+  Scene(Settings const& aSettings, png::image<png::gray_pixel> const& aBillboard) {
+    auto earthRadius = aSettings.mEarthRadius * 1000.0;
+    auto effectiveRadius = (aSettings.mEarthForm == Eikonal::EarthForm::cFlat ? std::numeric_limits<double>::infinity() : earthRadius);
+    mObjects.push_back(std::make_unique<Object>(aBillboard, aSettings.mDist, aSettings.mBullLift, aSettings.mHeight, effectiveRadius));
+    std::vector<Object const*> others;
+    for(auto const& object : aSettings.mObjects) {
+      mObjects.push_back(std::make_unique<Object>(*object.mImage, object.mDist, object.mLift, object.mHeight, effectiveRadius, object.mCenter));
+      others.push_back(mObjects.back().get());
+    }
+    mMedium = std::make_unique<Medium>(aSettings.mParaRk, aSettings.mEarthForm, earthRadius, aSettings.mBase,
+                                       aSettings.mTempAmb, aSettings.mTempAmbMin, aSettings.mTempAmbMax, aSettings.mTempBase, *mObjects.front(), others);
+  }
+
+  Medium& getMedium() { return *mMedium; }
+};
+
+// FNV-1a of everything the texel values of a frame depend on, to tell journals of other parameters.
+uint64_t getJournalHash(Settings const& aSettings, png::image<png::gray_pixel> const& aBillboard, png::image<png::gray_pixel> const& aSurface) {
+  uint64_t result = 14695981039346656037u;
+  auto add = [&result](auto const aValue) {
+    unsigned char bytes[sizeof(aValue)];
+    std::memcpy(bytes, &aValue, sizeof(aValue));
+    for(auto byte : bytes) {
+      result = (result ^ byte) * 1099511628211u;
+    }
+  };
+  auto const& rk = aSettings.mParaRk;
+  auto const& im = aSettings.mParaIm;
+  add(rk.mStepper);
+  add(rk.mDistAlongRay);
+  add(rk.mTolAbs);
+  add(rk.mTolRel);
+  add(rk.mStep1);
+  add(rk.mStepMin);
+  add(rk.mStepMax);
+  add(rk.mMaxCosDirChange);
+  add(im.mCamCenter);
+  add(im.mTilt);
+  add(im.mBorderFactor);
+  add(im.mResolutionX);
+  add(im.mSubsample);
+  add(im.mStepHints);
+  add(im.mSymmetry);
+  add(im.mTolLoose);
+  add(im.mPrecision);
+  add(aSettings.mBase);
+  add(aSettings.mEarthForm);
+  add(aSettings.mEarthRadius);
+  add(aSettings.mBullLift);
+  add(aSettings.mDist);
+  add(aSettings.mHeight);
+  add(aSettings.mTempAmb);
+  add(aSettings.mTempAmbMin);
+  add(aSettings.mTempAmbMax);
+  add(aSettings.mTempBase);
+  std::vector<png::image<png::gray_pixel> const*> images = { &aBillboard, &aSurface };
+  for(auto const& object : aSettings.mObjects) {
+    add(object.mDist);
+    add(object.mLift);
+    add(object.mHeight);
+    add(object.mCenter);
+    images.push_back(object.mImage.get());
+  }
+  for(auto image : images) {
+    add(image->get_width());
+    add(image->get_height());
+    for(uint32_t y = 0u; y < image->get_height(); ++y) {
+      for(uint32_t x = 0u; x < image->get_width(); ++x) {
+        add(image->get_pixel(x, y));
+      }
+    }
+  }
+  return result;
+}
+
+void render(Settings const& aSettings, png::image<png::gray_pixel> const& aBillboard, png::image<png::gray_pixel> const& aSurface,
+            std::string const& aNameOut, std::string const& aNameMarks, Image::LimitHints * const aHints = nullptr, std::string const& aNameStats = "",
+            std::string const& aNameJournal = "") {
+  Scene scene(aSettings, aBillboard);
+  auto &medium = scene.getMedium();
+  Image image(aSettings.mParaIm, medium);
+  if(aHints != nullptr) {
+    image.setLimitHints(*aHints);
+  }
+  else {} // nothing to do
+  if(!aNameJournal.empty()) {
+    image.setJournal(aNameJournal, getJournalHash(aSettings, aBillboard, aSurface));
+  }
+  else {} // nothing to do
+  image.process(aSurface, aNameOut.c_str(), aNameMarks.c_str());
+  for(auto const& region : image.getUnderRefined()) {
+    std::cout << aNameOut << " under-refined region x y width height: " << region.mX << ' ' << region.mY << ' '
+              << region.mWidth << ' ' << region.mHeight << " with " << region.mCount << " coarse pixels\n";
+  }
+  if(image.getProfiler().isEnabled()) {
+    std::ostringstream report;   // In one piece for concurrent sweep frames
+    report << "Profile of " << aNameOut << ":\n";
+    image.getProfiler().print(report);
+    std::cout << report.str() << std::flush;
+  }
+  else {} // nothing to do
+  if(!aNameStats.empty()) {
+    image.writeStatistics(aNameStats.c_str());
+  }
+  else {} // nothing to do
+  if(aHints != nullptr) {
+    *aHints = image.getLimitHints();
+  }
+  else {} // nothing to do
+}
+
+// Renders the whole grid in this process. Inputs are decoded only once, frames run concurrently in
+// contiguous chunks, each frame getting an equal share of the CPUs. Neighbouring frames of a chunk
+// differ only slightly, so each one starts its limit searches from the results of the previous one.
+// Progress is printed unless aSilent.
+void sweep(std::vector<Settings> const& aFrames, png::image<png::gray_pixel> const& aBillboard, png::image<png::gray_pixel> const& aSurface,
+           std::string const& aNameSeries, std::string const& aNameMarks, bool const aSilent) {
+  uint32_t nCpus = std::thread::hardware_concurrency();
+  nCpus -= (nCpus <= aFrames.front().mParaIm.mRestrictCpu ? nCpus - 1u : aFrames.front().mParaIm.mRestrictCpu);
+  uint32_t nFrames = aFrames.size();
+  uint32_t nWorkers = std::min(nCpus, nFrames);
+  uint32_t threadsPerFrame = std::max(1u, nCpus / nFrames);
+  std::mutex coutMutex;
+  uint32_t finished = 0u;
+  std::vector<std::thread> workers(nWorkers);
+  for(uint32_t w = 0u; w < nWorkers; ++w) {
+    workers[w] = std::thread([&, w] {
+      Image::LimitHints hints;
+      for(uint32_t f = w * nFrames / nWorkers; f < (w + 1u) * nFrames / nWorkers; ++f) {
+        auto settings = aFrames[f];
+        settings.mParaIm.mThreadCount = threadsPerFrame;
+        render(settings, aBillboard, aSurface, formatSeriesName(aNameSeries, f + 1u),
+               aNameMarks.empty() ? aNameMarks : formatSeriesName(aNameMarks, f + 1u), &hints);
+        std::lock_guard<std::mutex> lock(coutMutex);
+        ++finished;
+        if(!aSilent) {
+          std::cout << "Frame " << f + 1u << " done, " << finished << " of " << nFrames << std::endl;
+        }
+        else {} // nothing to do
+      }
+    });
+  }
+  for(auto& worker : workers) {
+    worker.join();
+  }
+}
+
+// One step of a distributed render, see Image::prepareTiles. The scene is built like in render.
+void renderTileStep(Settings const& aSettings, png::image<png::gray_pixel> const& aBillboard, png::image<png::gray_pixel> const& aSurface,
+                    TileStep const aStep, uint32_t const aIndex, uint32_t const aCount, std::string const& aNameState,
+                    std::string const& aNameTiles, std::string const& aNameOut, std::string const& aNameMarks) {
+  Scene scene(aSettings, aBillboard);
+  auto &medium = scene.getMedium();
+  Image image(aSettings.mParaIm, medium);
+  std::string name;
+  if(aStep == TileStep::cPrepare) {
+    name = aNameState;
+    image.prepareTiles(aSurface.get_width() > 0u, aNameState.c_str());
+  }
+  else if(aStep == TileStep::cRender) {
+    name = formatSeriesName(aNameTiles, aIndex);
+    image.processTile(aSurface, aNameState.c_str(), aIndex, aCount, name.c_str());
+  }
+  else {
+    name = aNameOut;
+    std::vector<std::string> nameTiles;
+    for(uint32_t i = 0u; i < aCount; ++i) {
+      nameTiles.push_back(formatSeriesName(aNameTiles, i));
+    }
+    image.mergeTiles(aNameState.c_str(), nameTiles, aNameOut.c_str(), aNameMarks.c_str());
+  }
+  if(image.getProfiler().isEnabled()) {
+    std::cout << "Profile of " << name << ":\n";
+    image.getProfiler().print(std::cout);
+    std::cout << std::flush;
+  }
+  else {} // nothing to do
+}
+
+// Runs --tile i/aCount for each tile in worker processes started from this command line, all at once, sharing
+// the CPUs. Options given here for the coordinator or the CPU share are replaced. The output of the workers
+// comes through pipes and is printed with the tile index. Returns true if all workers succeeded.
+bool runTileWorkers(int const aArgc, char ** const aArgv, uint32_t const aCount, uint32_t const aCpuCount) {
+  std::vector<std::string> common;
+  for(int i = 0; i < aArgc; ++i) {
+    std::string arg = aArgv[i];
+    bool keep = true;
+    for(std::string const name : { "--tiles", "--saveCpus", "--silent" }) {
+      if(arg == name) {
+        keep = false;
+        ++i;  // its value
+      }
+      else if(arg.compare(0u, name.size() + 1u, name + '=') == 0) {
+        keep = false;
+      }
+      else {} // nothing to do
+    }
+    if(keep) {
+      common.push_back(arg);
+    }
+    else {} // nothing to do
+  }
+  uint32_t threadsPerWorker = std::max(1u, aCpuCount / aCount);
+  common.push_back("--saveCpus");
+  common.push_back(std::to_string(std::max(1u, std::thread::hardware_concurrency()) - threadsPerWorker));
+
+  struct Worker {
+    pid_t       mPid;
+    int         mPipe;
+    std::string mPending;  // Output after the last complete line.
+  };
+  bool result = true;
+  std::vector<Worker> workers;
+  for(uint32_t i = 0u; i < aCount; ++i) {
+    auto args = common;
+    args.push_back("--tile");
+    args.push_back(std::to_string(i) + '/' + std::to_string(aCount));
+    std::vector<char*> argv;
+    for(auto &arg : args) {
+      argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+    int fds[2];
+    if(pipe2(fds, O_CLOEXEC) != 0) {
+      std::cerr << "Can't create a pipe for tile worker " << i << ": " << std::strerror(errno) << '\n';
+      result = false;
+      break;
+    }
+    else {} // nothing to do
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+    pid_t pid;
+    int error = posix_spawnp(&pid, argv.front(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if(error != 0) {
+      close(fds[0]);
+      std::cerr << "Can't start tile worker " << i << ": " << std::strerror(error) << '\n';
+      result = false;
+      break;
+    }
+    else {} // nothing to do
+    workers.push_back(Worker{pid, fds[0], ""});
+  }
+
+  auto open = workers.size();
+  while(open > 0u) {
+    std::vector<pollfd> polls;
+    for(auto const& worker : workers) {
+      polls.push_back(pollfd{worker.mPipe, POLLIN, 0});
+    }
+    if(poll(polls.data(), polls.size(), -1) < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      else {} // nothing to do
+      std::cerr << "Can't read the tile workers: " << std::strerror(errno) << '\n';
+      result = false;
+      break;
+    }
+    else {} // nothing to do
+    for(uint32_t i = 0u; i < workers.size(); ++i) {
+      auto &worker = workers[i];
+      if(worker.mPipe >= 0 && polls[i].revents != 0) {
+        char buffer[4096];
+        auto count = read(worker.mPipe, buffer, sizeof(buffer));
+        if(count > 0) {
+          worker.mPending.append(buffer, count);
+        }
+        else {
+          close(worker.mPipe);
+          worker.mPipe = -1;
+          --open;
+          if(!worker.mPending.empty()) {
+            worker.mPending += '\n';
+          }
+          else {} // nothing to do
+        }
+        for(auto end = worker.mPending.find('\n'); end != std::string::npos; end = worker.mPending.find('\n')) {
+          std::cout << "tile " << i << ": " << worker.mPending.substr(0u, end + 1u);
+          worker.mPending.erase(0u, end + 1u);
+        }
+        std::cout << std::flush;
+      }
+      else {} // nothing to do
+    }
+  }
+  for(uint32_t i = 0u; i < workers.size(); ++i) {
+    if(workers[i].mPipe >= 0) {
+      close(workers[i].mPipe);
+    }
+    else {} // nothing to do
+    int status;
+    if(waitpid(workers[i].mPid, &status, 0) != workers[i].mPid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      std::cerr << "Tile worker " << i << " failed.\n";
+      result = false;
+    }
+    else {} // nothing to do
+  }
+  return result;
+}
+
+// Renders the ROI into aNameOut with the info in aNameOut.json. The scene is built like in render.
+void renderRoi(Settings const& aSettings, png::image<png::gray_pixel> const& aBillboard, Image::Roi const& aRoi, std::string const& aNameOut) {
+  Scene scene(aSettings, aBillboard);
+  auto &medium = scene.getMedium();
+  Image image(aSettings.mParaIm, medium);
+  image.processRoi(aRoi, aNameOut.c_str(), (aNameOut + ".json").c_str());
+  for(auto const& region : image.getUnderRefined()) {
+    std::cout << aNameOut << " under-refined region x y width height: " << region.mX << ' ' << region.mY << ' '
+              << region.mWidth << ' ' << region.mHeight << " with " << region.mCount << " coarse pixels\n";
+  }
+  if(image.getProfiler().isEnabled()) {
+    std::cout << "Profile of " << aNameOut << ":\n";
+    image.getProfiler().print(std::cout);
+    std::cout << std::flush;
+  }
+  else {} // nothing to do
+}
+
+void renderSplat(Settings const& aSettings, png::image<png::gray_pixel> const& aBillboard, std::string const& aNameOut) {
+  Scene scene(aSettings, aBillboard);
+  auto &medium = scene.getMedium();
+  Image image(aSettings.mParaIm, medium);
+  image.processSplat(aNameOut.c_str());
+  if(image.getProfiler().isEnabled()) {
+    std::cout << "Profile of " << aNameOut << ":\n";
+    image.getProfiler().print(std::cout);
+    std::cout << std::flush;
+  }
+  else {} // nothing to do
+}
+
+// Renders aBillboard once keeping the hit points, then shades each frame of aWarpIn with them: a directory of
+// PNG files of the billboard size taken in name order, or "-" for raw 8 bit frames of that size on stdin. The
+// frames go to aWarpOut, a filename pattern like --nameSeries, or "-" for a YUV4MPEG2 stream on stdout.
+void renderWarp(Settings const& aSettings, png::image<png::gray_pixel> const& aBillboard, png::image<png::gray_pixel> const& aSurface,
+                std::string const& aNameOut, std::string const& aNameMarks, std::string const& aWarpIn, std::string const& aWarpOut, uint32_t const aFps) {
+  Scene scene(aSettings, aBillboard);
+  auto &medium = scene.getMedium();
+  auto paraIm = aSettings.mParaIm;
+  paraIm.mRetainHits = true;
+  Image image(paraIm, medium);
+  image.process(aSurface, aNameOut.c_str(), aNameMarks.c_str());
+  image.prepareWarp();
+
+  uint32_t const width = aBillboard.get_width();
+  uint32_t const height = aBillboard.get_height();
+  std::vector<std::string> names;
+  if(aWarpIn != "-") {
+    for(auto const& entry : std::filesystem::directory_iterator(aWarpIn)) {
+      if(entry.is_regular_file() && entry.path().extension() == ".png") {
+        names.push_back(entry.path().string());
+      }
+      else {} // nothing to do
+    }
+    std::sort(names.begin(), names.end());
+  }
+  else {} // nothing to do
+  std::vector<uint8_t> frame(width * height);
+  auto readFrame = [&aWarpIn, &names, &frame, width, height](uint32_t const aIndex) {
+    bool result;
+    if(aWarpIn == "-") {
+      auto count = std::fread(frame.data(), 1u, frame.size(), stdin);
+      if(count > 0u && count < frame.size()) {
+        throw std::runtime_error("Incomplete frame on stdin.");
+      }
+      else {} // nothing to do
+      result = (count > 0u);
+    }
+    else {
+      result = (aIndex < names.size());
+      if(result) {
+        png::image<png::gray_pixel> input(names[aIndex]);
+        if(input.get_width() != width || input.get_height() != height) {
+          throw std::runtime_error(names[aIndex] + " differs in size from the billboard.");
+        }
+        else {} // nothing to do
+        for(uint32_t y = 0u; y < height; ++y) {
+          for(uint32_t x = 0u; x < width; ++x) {
+            frame[x + y * width] = input.get_pixel(x, y);
+          }
+        }
+      }
+      else {} // nothing to do
+    }
+    return result;
+  };
+
+  auto begin = std::chrono::steady_clock::now();
+  uint32_t count = 0u;
+  while(readFrame(count)) {
+    if(aWarpOut == "-") {
+      image.warp(frame.data(), std::cout, count == 0u, aFps);
+    }
+    else {
+      image.warp(frame.data(), formatSeriesName(aWarpOut, count + 1u).c_str(), aNameMarks.empty());
+    }
+    ++count;
+  }
+  std::cout << std::flush;
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  std::cerr << "warped " << count << " frames in " << elapsed.count() << " s\n";  // stdout may hold the stream
+}
+
+// Keeps the decoded inputs and the last frame with its hit points in memory, and redoes only what a request
+// invalidates. A billboard of the same size, other marks or output names only need the kept hit points
+// reshaded, everything else needs a new frame, which starts its searches from the previous one.
+class Server final {
+public:
+  struct Request {
+    Settings    mSettings;  // Resolved
+    std::string mNameIn;
+    std::string mNameSurf;
+    std::string mNameOut;
+    std::string mNameMarks;
+  };
+
+private:
+  // The name with the modification time and size, so a file rewritten under the same name is decoded again.
+  using FileKey = std::tuple<std::string, std::filesystem::file_time_type, std::uintmax_t>;
+
+  std::map<FileKey, png::image<png::gray_pixel>> mDecoded;  // Only the inputs of the last request
+  std::optional<Request>  mLast;
+  FileKey                 mLastSurf;
+  std::unique_ptr<Object> mObject;
+  std::unique_ptr<Medium> mMedium;
+  std::unique_ptr<Image>  mImage;
+  Image::LimitHints       mHints;
+
+public:
+  // Returns true if reshading was enough.
+  bool serve(Request const& aRequest);
+
+private:
+  static FileKey getKey(std::string const& aName);
+  png::image<png::gray_pixel> const& decode(FileKey const& aKey);
+  static bool isSameGeometry(Request const& aOld, Request const& aNew);
+};
+
+// A missing file gets a key without time and size, and decode throws for it.
+Server::FileKey Server::getKey(std::string const& aName) {
+  FileKey result{aName, {}, 0u};
+  if(!aName.empty()) {
+    std::error_code error;
+    auto time = std::filesystem::last_write_time(aName, error);
+    auto size = std::filesystem::file_size(aName, error);
+    if(!error) {
+      result = FileKey{aName, time, size};
+    }
+    else {} // nothing to do
+  }
+  else {} // nothing to do
+  return result;
+}
+
+png::image<png::gray_pixel> const& Server::decode(FileKey const& aKey) {
+  auto found = mDecoded.find(aKey);
+  if(found == mDecoded.end()) {
+    auto const& name = std::get<0>(aKey);
+    png::image<png::gray_pixel> image;
+    if(!name.empty()) {
+      image.read(name);
+    }
+    else {} // nothing to do
+    found = mDecoded.emplace(aKey, std::move(image)).first;
+  }
+  else {} // nothing to do
+  return found->second;
+}
+
+bool Server::isSameGeometry(Request const& aOld, Request const& aNew) {
+  auto key = [](Request const& aR) {
+    auto const& rk = aR.mSettings.mParaRk;
+    auto const& im = aR.mSettings.mParaIm;
+    auto const& s = aR.mSettings;
+    return std::tie(rk.mStepper, rk.mDistAlongRay, rk.mTolAbs, rk.mTolRel, rk.mStep1, rk.mStepMin, rk.mStepMax, rk.mMaxCosDirChange,
+                    im.mCamCenter, im.mTilt, im.mBorderFactor, im.mResolutionX, im.mSubsample, im.mOutputFormat, im.mTimeBudget, im.mStepHints, im.mSymmetry, im.mTolLoose, im.mPrecision,
+                    s.mBase, s.mEarthForm, s.mEarthRadius, s.mBullLift, s.mDist, s.mHeight, s.mTempAmb, s.mTempAmbMin, s.mTempAmbMax, s.mTempBase,
+                    aR.mNameSurf);
+  };
+  return key(aOld) == key(aNew);
+}
+
+bool Server::serve(Request const& aRequest) {
+  auto const keyIn = getKey(aRequest.mNameIn);
+  auto const keySurf = getKey(aRequest.mNameSurf);
+  auto const& billboard = decode(keyIn);
+  bool result = mLast && isSameGeometry(*mLast, aRequest) && keySurf == mLastSurf && mObject->replaceImage(billboard);
+  if(result) {
+    mImage->reshade(aRequest.mSettings.mParaIm, aRequest.mNameOut.c_str(), aRequest.mNameMarks.c_str());
+  }
+  else {
+    auto const& settings = aRequest.mSettings;
+    auto earthRadius = settings.mEarthRadius * 1000.0;
+    auto effectiveRadius = (settings.mEarthForm == Eikonal::EarthForm::cFlat ? std::numeric_limits<double>::infinity() : earthRadius);
+    auto paraIm = settings.mParaIm;
+    paraIm.mRetainHits = true;
+    mLast.reset();
+    mImage.reset();
+    mMedium.reset();
+    mObject = std::make_unique<Object>(billboard, settings.mDist, settings.mBullLift, settings.mHeight, effectiveRadius);
+    mMedium = std::make_unique<Medium>(settings.mParaRk, settings.mEarthForm, earthRadius, settings.mBase,
+                                       settings.mTempAmb, settings.mTempAmbMin, settings.mTempAmbMax, settings.mTempBase, *mObject);
+    mImage = std::make_unique<Image>(paraIm, *mMedium);
+    mImage->setLimitHints(mHints);
+    mImage->process(decode(keySurf), aRequest.mNameOut.c_str(), aRequest.mNameMarks.c_str());
+    mHints = mImage->getLimitHints();
+  }
+  mLast = aRequest;
+  mLastSurf = keySurf;
+  for(auto i = mDecoded.begin(); i != mDecoded.end(); ) {
+    if(i->first != keyIn && i->first != keySurf) {
+      i = mDecoded.erase(i);
+    }
+    else {
+      ++i;
+    }
+  }
+  return result;
+}
 
 int main(int aArgc, char **aArgv) {
-  RungeKuttaRayBending::Parameters paraRk;
-  Image::Parameters                paraIm;
+  Settings settings;
+  auto &paraRk = settings.mParaRk;
+  auto &paraIm = settings.mParaIm;
 
   CLI::App opt{"Usage"};
+  bool autotune = false;
+  opt.add_option("--autotune", autotune, "search the fastest solver settings meeting --autotuneError on a ray sample, cached in --nameAutotune (true, false) [false]");
+  double autotuneError = 0.5;
+  opt.add_option("--autotuneError", autotuneError, "maximal 95th percentile of hit errors for autotune (billboard pixels) [0.5]");
   std::string nameBase = "water";
   opt.add_option("--base", nameBase, "base type (conventional / porous / water) [water]");
   paraIm.mBorderFactor = 0.05;
   opt.add_option("--borderFactor", paraIm.mBorderFactor, "border adjust factor, 0 means almost no border (-) [0.05]");
-  double bullLift = 0.0;
-  opt.add_option("--bullLift", bullLift, "lift of bulletin from ground (m) [0.0]");
+  settings.mBullLift = 0.0;
+  opt.add_option("--bullLift", settings.mBullLift, "lift of bulletin from ground (m) [0.0]");
   paraIm.mCamCenter = 1.1;
   opt.add_option("--camCenter", paraIm.mCamCenter, "height of camera center (m) [1.1]");
-  double dist = 1000.0;
-  opt.add_option("--dist", dist, "distance of bulletin and camera [1000]");
+  settings.mDist = 1000.0;
+  opt.add_option("--dist", settings.mDist, "distance of bulletin and camera [1000]");
   std::string nameForm = "round";
   opt.add_option("--earthForm", nameForm, "Earth form (flat / round) [round]");
-  double rawRadius = 6371.0;
-  opt.add_option("--earthRadius", rawRadius, "Earth radius (km) [6371.0]");
-  double height = 9.0;
-  opt.add_option("--height", height, "height of bulletin (m) [9.0]  its width will be calculated");
+  settings.mEarthRadius = 6371.0;
+  opt.add_option("--earthRadius", settings.mEarthRadius, "Earth radius (km) [6371.0]");
+  settings.mHeight = 9.0;
+  opt.add_option("--height", settings.mHeight, "height of bulletin (m) [9.0]  its width will be calculated");
   paraIm.mMarkAcross = false;
   opt.add_option("--markAcross", paraIm.mMarkAcross, "draw mark line across the image (true, false) [false]");
   paraIm.mMarkIndent = 0.9;
@@ -33,20 +908,54 @@ int main(int aArgc, char **aArgv) {
   opt.add_option("--markTriple", paraIm.mMarkTriple, "draw mark lines in triple width (true, false) [false]");
   paraRk.mMaxCosDirChange = 0.99999999999;
   opt.add_option("--maxCosDirChange", paraRk.mMaxCosDirChange, "Maximum of cos of direction change to reset big step [0.99999999999]");
+  std::string nameAutotune = "autotune.txt";
+  opt.add_option("--nameAutotune", nameAutotune, "autotune cache filename [autotune.txt]");
   std::string nameIn = "monoscopeRca.png";
   opt.add_option("--nameIn", nameIn, "input filename [monoscopeRca.png]");
+  std::string nameJournal = "";
+  opt.add_option("--nameJournal", nameJournal, "checkpoint journal of the mirage, a render with the same parameters resumes from it, no sweeps, tiles, time budget or raw output []");
+  std::string nameMarks = "";
+  opt.add_option("--nameMarks", nameMarks, "mark overlay filename, marks are burnt into png8 output if empty, pattern like --nameSeries for sweeps []");
   std::string nameOut = "result.png";
   opt.add_option("--nameOut", nameOut, "output filename [result.png]");
+  std::string nameSeries = "series%03d.png";
+  opt.add_option("--nameSeries", nameSeries, "output filename pattern for sweeps, %d is replaced by the 1-based frame number [series%03d.png]");
+  std::string nameState = "tiles.state";
+  opt.add_option("--nameState", nameState, "limits shared by the tiles of a distributed render [tiles.state]");
+  std::string nameStats = "";
+  opt.add_option("--nameStats", nameStats, "solver statistics filename prefix for heatmaps and JSON summary, needs a SOLVER_STATISTICS build, no sweeps []");
   std::string nameSurf = "";
   opt.add_option("--nameSurf", nameSurf, "surface filename, no rendering if empty []");
+  std::string nameTiles = "tile%03d.bin";
+  opt.add_option("--nameTiles", nameTiles, "tile filename pattern of a distributed render, %d is replaced by the 0-based tile index [tile%03d.bin]");
+  std::vector<std::string> textObjects;
+  opt.add_option("--object", textObjects, "another object in the scene as name,dist,lift,height,center with the image name, distance, lift and height like for the bulletin and the sideways shift of its center (m), repeat for more []");
+  std::string nameFormat = "png8";
+  opt.add_option("--outFormat", nameFormat, "output format (png8 / png16 / float / raw) [png8]");
+  std::string namePrecision = "double";
+  opt.add_option("--precision", namePrecision, "precision of rays away from the limits and the mirror line, flagged mixed ones are traced again in double (double / mixed) [double]");
+  paraIm.mProfile = false;
+  opt.add_option("--profile", paraIm.mProfile, "print wall time, CPU time and hardware counters of the render phases and threads (true, false) [false]");
   paraIm.mResolutionX = 1000u;
   opt.add_option("--resolution", paraIm.mResolutionX, "film resulution in X direction (pixel) [1000]");
+  std::string textRoi = "";
+  opt.add_option("--roi", textRoi, "render only this window of the full frame magnified by --roiZoom as x,y,width,height in full frame pixels, info goes to <nameOut>.json []");
+  std::string textRoiAngles = "";
+  opt.add_option("--roiAngles", textRoiAngles, "like --roi, but the window is given by two corners as azimuth1,elevation1,azimuth2,elevation2 (degrees) []");
+  uint32_t roiZoom = 4u;
+  opt.add_option("--roiZoom", roiZoom, "ROI output pixels per full frame pixel in each direction (count) [4]");
   paraIm.mRestrictCpu = 0u;
   opt.add_option("--saveCpus", paraIm.mRestrictCpu, "amount of CPUs to save to keep the system responsive (natural integer) [0]");
+  bool serverMode = false;
+  opt.add_option("--server", serverMode, "keep running and render again for each line of option changes read from stdin (true, false) [false]");
   bool silent = true;
   opt.add_option("--silent", silent, "surpress parameter echo (true, false) [true]");
+  bool splat = false;
+  opt.add_option("--splat", splat, "write the mirage irradiance for rays emitted evenly by the billboard as PFM into --nameOut, showing the caustic at the mirror line, no surface or marks (true, false) [false]");
   paraRk.mStep1 = 0.01;
   opt.add_option("--step1", paraRk.mStep1, "initial step size (m) [0.01]");
+  paraIm.mStepHints = true;
+  opt.add_option("--stepHints", paraIm.mStepHints, "start the solver with the step sizes of the previous ray in the row (true, false) [true]");
   paraRk.mStepMin = 1e-4;
   opt.add_option("--stepMin", paraRk.mStepMin, "maximal step size (m) [1e-4]");
   paraRk.mStepMax = 55.5;
@@ -55,137 +964,344 @@ int main(int aArgc, char **aArgv) {
   opt.add_option("--stepper", nameStepper, "stepper type (RungeKutta23 / RungeKuttaClass4 / RungeKuttaFehlberg45 / RungeKuttaCashKarp45 / RungeKuttaPrinceDormand89 / BulirschStoerBaderDeuflhard) [RungeKuttaFehlberg45]");
   paraIm.mSubsample = 2u;
   opt.add_option("--subsample", paraIm.mSubsample, "subsampling each pixel in both directions (count) [2]");
-  double tempAmb = std::nan("");
-  opt.add_option("--tempAmb", tempAmb, "ambient temperature (Celsius) [20 for conventional, 38.5 for porous, 10 for water]");
-  double tempAmbMin = std::nan("");
-  opt.add_option("--tempAmbMin", tempAmbMin, "minimum ambient temperature for limit calculation (Celsius) [TODO for conventional, TODO for porous, tempBase-5 for water]");
-  double tempAmbMax = std::nan("");
-  opt.add_option("--tempAmbMax", tempAmbMax, "maximum ambient temperature for limit calculation (Celsius) [TODO for conventional, TODO for porous, tempBase+1 for water]");
-  double tempBase = 13.0;
-  opt.add_option("--tempBase", tempBase, "base temperature, only for water (Celsius) [13]");
+  paraIm.mSymmetry = true;
+  opt.add_option("--symmetry", paraIm.mSymmetry, "trace only the left half of the mirage columns if the frame is left-right symmetric, mirror the hits to the right half (true, false) [true]");
+  std::vector<std::string> textSweeps;
+  opt.add_option("--sweep", textSweeps, "render a series as param=start:step:count instead of a single image, repeat for a grid with the last one changing fastest, param is a numeric option name []");
+  settings.mTempAmb = std::nan("");
+  opt.add_option("--tempAmb", settings.mTempAmb, "ambient temperature (Celsius) [20 for conventional, 38.5 for porous, 10 for water]");
+  settings.mTempAmbMin = std::nan("");
+  opt.add_option("--tempAmbMin", settings.mTempAmbMin, "minimum ambient temperature for limit calculation (Celsius) [TODO for conventional, TODO for porous, tempBase-5 for water]");
+  settings.mTempAmbMax = std::nan("");
+  opt.add_option("--tempAmbMax", settings.mTempAmbMax, "maximum ambient temperature for limit calculation (Celsius) [TODO for conventional, TODO for porous, tempBase+1 for water]");
+  settings.mTempBase = 13.0;
+  opt.add_option("--tempBase", settings.mTempBase, "base temperature, only for water (Celsius) [13]");
+  std::string textTile = "";
+  opt.add_option("--tile", textTile, "one step of a distributed render: prepare writes --nameState, i/N renders row band i of N into --nameTiles, merge/N assembles N tiles and the marks into --nameOut []");
+  uint32_t tiles = 0u;
+  opt.add_option("--tiles", tiles, "render in this many tile worker processes on this host and merge them, using --nameState and --nameTiles (count) [0, meaning no tiling]");
+  paraIm.mTimeBudget = 0.0;
+  opt.add_option("--timeBudget", paraIm.mTimeBudget, "render time limit, after a coarse image pixels are refined in priority order until it (s) [0, meaning unlimited]");
   paraIm.mTilt = 0.0;
   opt.add_option("--tilt", paraIm.mTilt, "camera tilt, neg downwards (degrees) [0.0]");
   paraRk.mTolAbs = 0.001;
   opt.add_option("--tolAbs", paraRk.mTolAbs, "absolute tolerance (m) [1e-3]");
+  paraIm.mTolLoose = 1.0;
+  opt.add_option("--tolLoose", paraIm.mTolLoose, "tolerance and initial step factor for rays away from the limits and the mirror line, flagged rays are traced again (factor) [1, meaning off]");
   paraRk.mTolRel = 0.001;
   opt.add_option("--tolRel", paraRk.mTolRel, "relative tolerance (m) [1e-3]");
+  uint32_t warpFps = 25u;
+  opt.add_option("--warpFps", warpFps, "frame rate written into the YUV4MPEG2 header of the warp mode (1/s) [25]");
+  std::string warpIn = "";
+  opt.add_option("--warpIn", warpIn, "warp mode: render --nameIn once, then shade each billboard frame of this directory of PNG files of the same size in name order, or of raw 8 bit frames on stdin for - []");
+  std::string warpOut = "warp%04d.png";
+  opt.add_option("--warpOut", warpOut, "warp mode output filename pattern like --nameSeries in --outFormat with marks unless --nameMarks is given, or - for YUV4MPEG2 on stdout [warp%04d.png]");
   CLI11_PARSE(opt, aArgc, aArgv);
+  paraIm.mThreadCount = 0u;
+  paraIm.mRetainHits = false;
 
-  Eikonal::Model base;
-  if(nameBase == "conventional") {
-    base = Eikonal::Model::cConventional;
-  }
-  else if(nameBase == "porous") {
-    base = Eikonal::Model::cPorous;
-  }
-  else if(nameBase == "water") {
-    base = Eikonal::Model::cWater;
-  }
-  else {
-    std::cerr << "Illegal base value: " << nameBase << '\n';
+  if(!interpret(nameBase, nameForm, nameFormat, namePrecision, nameStepper, settings)) {
     return 1;
   }
+  else {} // nothing to do
 
-  Eikonal::EarthForm earthForm;
-  if(nameForm == "flat") {
-    earthForm = Eikonal::EarthForm::cFlat;
+  std::vector<Sweep> sweeps(textSweeps.size());
+  uint32_t nFrames = 1u;
+  for(uint32_t i = 0u; i < sweeps.size(); ++i) {
+    if(!parseSweep(textSweeps[i], sweeps[i])) {
+      return 1;
+    }
+    else {} // nothing to do
+    nFrames *= sweeps[i].mCount;
   }
-  else if(nameForm == "round") {
-    earthForm = Eikonal::EarthForm::cRound;
+  if(serverMode && !sweeps.empty()) {
+    std::cerr << "Sweeps are not possible in server mode.\n";
+    return 1;
   }
-  else {
-    std::cerr << "Illegal Earth form value: " << nameForm << '\n';
+  else {} // nothing to do
+  TileStep tileStep;
+  uint32_t tileIndex;
+  uint32_t tileCount;
+  if(!parseTile(textTile, tileStep, tileIndex, tileCount)) {
     return 1;
   }
-
-  double earthRadius = rawRadius * 1000.0;
-
-  if(nameStepper == "RungeKutta23") {
-    paraRk.mStepper = StepperType::cRungeKutta23;
+  else {} // nothing to do
+  if((tileStep != TileStep::cNone || tiles > 0u) && (serverMode || !sweeps.empty() || (tileStep != TileStep::cNone && tiles > 0u))) {
+    std::cerr << "Tiles are not possible with sweeps, in server mode or with both --tile and --tiles.\n";
+    return 1;
   }
-  else if(nameStepper == "RungeKuttaClass4") {
-    paraRk.mStepper = StepperType::cRungeKuttaClass4;
+  else {} // nothing to do
+  std::optional<Image::Roi> roi;
+  if(!textRoi.empty() || !textRoiAngles.empty()) {
+    roi = Image::Roi{!textRoiAngles.empty(), 0.0, 0.0, 0.0, 0.0, roiZoom};
+    char tail;
+    if((!textRoi.empty() && !textRoiAngles.empty()) || roiZoom == 0u ||
+       std::sscanf((textRoi.empty() ? textRoiAngles : textRoi).c_str(), "%lf,%lf,%lf,%lf%c", &roi->mX1, &roi->mY1, &roi->mX2, &roi->mY2, &tail) != 4) {
+      std::cerr << "Illegal ROI, expected either --roi x,y,width,height or --roiAngles azimuth1,elevation1,azimuth2,elevation2 and a positive zoom.\n";
+      return 1;
+    }
+    else {} // nothing to do
+    if(!roi->mDegrees) {
+      roi->mX2 += roi->mX1;
+      roi->mY2 += roi->mY1;
+    }
+    else {} // nothing to do
   }
-  else if(nameStepper == "RungeKuttaFehlberg45") {
-    paraRk.mStepper = StepperType::cRungeKuttaFehlberg45;
+  else {} // nothing to do
+  if(roi && (serverMode || !sweeps.empty() || tileStep != TileStep::cNone || tiles > 0u || !nameJournal.empty() ||
+             paraIm.mOutputFormat == Image::OutputFormat::cRaw)) {
+    std::cerr << "The ROI is not possible with sweeps, tiles, the journal, raw output or in server mode.\n";
+    return 1;
   }
-  else if(nameStepper == "RungeKuttaCashKarp45") {
-    paraRk.mStepper = StepperType::cRungeKuttaCashKarp45;
+  else {} // nothing to do
+  if(!nameJournal.empty() && (serverMode || !sweeps.empty() || tileStep != TileStep::cNone || tiles > 0u ||
+                              paraIm.mTimeBudget > 0.0 || paraIm.mOutputFormat == Image::OutputFormat::cRaw)) {
+    std::cerr << "The journal is not possible with sweeps, tiles, time budget, raw output or in server mode.\n";
+    return 1;
   }
-  else if(nameStepper == "RungeKuttaPrinceDormand89") {
-    paraRk.mStepper = StepperType::cRungeKuttaPrinceDormand89;
+  else {} // nothing to do
+  if(!warpIn.empty() && (serverMode || !sweeps.empty() || tileStep != TileStep::cNone || tiles > 0u || roi || !nameJournal.empty() ||
+                         paraIm.mTimeBudget > 0.0 || paraIm.mOutputFormat == Image::OutputFormat::cRaw)) {
+    std::cerr << "The warp mode is not possible with sweeps, tiles, the ROI, the journal, time budget, raw output or in server mode.\n";
+    return 1;
   }
-  else if(nameStepper == "BulirschStoerBaderDeuflhard") {
-    paraRk.mStepper = StepperType::cBulirschStoerBaderDeuflhard;
+  else {} // nothing to do
+  if(splat && (serverMode || !sweeps.empty() || tileStep != TileStep::cNone || tiles > 0u || roi || !nameJournal.empty() || !warpIn.empty())) {
+    std::cerr << "Splatting is not possible with sweeps, tiles, the ROI, the journal, the warp mode or in server mode.\n";
+    return 1;
   }
-  else {
-    std::cerr << "Illegal stepper value: " << nameStepper << '\n';
+  else {} // nothing to do
+  if(!warpIn.empty() && (warpOut == "-" ? !silent || warpFps == 0u : formatSeriesName(warpOut, 1u).empty())) {
+    std::cerr << "Warp output must be - with --silent true and a positive frame rate, or a filename pattern with exactly one %d like conversion.\n";
     return 1;
   }
-
-  if(std::isnan(tempAmb)) {
-    tempAmb = (base == Eikonal::Model::cConventional ? 20.0 :
-              (base == Eikonal::Model::cPorous ? 38.5 : 10.0));
+  else {} // nothing to do
+  if(!textObjects.empty() && (serverMode || !warpIn.empty())) {
+    std::cerr << "More objects are not possible with the warp mode or in server mode.\n";
+    return 1;
   }
   else {} // nothing to do
-
-  if(std::isnan(tempAmbMin)) {
-    tempAmbMin = tempBase - 5.0;
+  for(auto const& text : textObjects) {
+    settings.mObjects.emplace_back();
+    if(!parseObject(text, settings.mObjects.back())) {
+      return 1;
+    }
+    else {} // nothing to do
+  }
+  if((tileStep != TileStep::cNone || tiles > 0u) && paraIm.mOutputFormat == Image::OutputFormat::cRaw) {
+    std::cerr << "Raw output can't be tiled.\n";
+    return 1;
   }
   else {} // nothing to do
-
-  if(std::isnan(tempAmbMax)) {
-    tempAmbMax = tempBase + 1.0;
+  if((tileStep != TileStep::cNone || tiles > 0u) && formatSeriesName(nameTiles, 0u).empty()) {
+    std::cerr << "Tile filename pattern must contain exactly one %d like conversion.\n";
+    return 1;
   }
   else {} // nothing to do
-
-  if(tempAmb < tempAmbMin || tempAmb > tempAmbMax || tempBase < tempAmbMin || tempBase > tempAmbMax) {
-    std::cerr << "TempAmb and tempBase must be between tempAmbMin and tempAmbMax.\n";
+  if(!sweeps.empty() && (formatSeriesName(nameSeries, 1u).empty() || (!nameMarks.empty() && formatSeriesName(nameMarks, 1u).empty()))) {
+    std::cerr << "Sweep filename patterns must contain exactly one %d like conversion.\n";
     return 1;
   }
   else {} // nothing to do
 
+  auto unresolved = settings;
+  std::vector<Settings> frames;
+  for(uint32_t f = 0u; f < nFrames; ++f) {
+    frames.push_back(settings);
+    uint32_t rest = f;
+    for(uint32_t i = sweeps.size(); i > 0u; --i) {
+      auto const& sweep = sweeps[i - 1u];
+      sweep.mAccess(frames.back()) = sweep.mStart + sweep.mStep * (rest % sweep.mCount);
+      rest /= sweep.mCount;
+    }
+    if(!resolve(frames.back())) {
+      return 1;
+    }
+    else {} // nothing to do
+  }
+  settings = frames.front();
+
   if(!silent) {
-    std::cout << "base type:                                         " << nameBase << ' ' << static_cast<int>(base) << '\n';
+    std::cout << "autotune solver:                                   " << autotune << '\n';
+    std::cout << "autotune max hit error (billboard pixels):         " << autotuneError << '\n';
+    std::cout << "base type:                                         " << nameBase << ' ' << static_cast<int>(settings.mBase) << '\n';
     std::cout << "border factor:                                     " << paraIm.mBorderFactor << '\n';
-    std::cout << "lift of bulletin from ground (m): .  .  .  .  .  . " << bullLift << '\n';
+    std::cout << "lift of bulletin from ground (m): .  .  .  .  .  . " << settings.mBullLift << '\n';
     std::cout << "height of camera center (m):                       " << paraIm.mCamCenter << '\n';
-    std::cout << "distance of bulletin and camera (m):               " << dist << '\n';
-    std::cout << "Earth form:                          .  .  .  .  . " << nameForm << ' ' << static_cast<int>(earthForm) << '\n';
-    std::cout << "Earth radius (km):                                 " << earthRadius / 1000.0 << '\n';
-    std::cout << "height of bulletin (m):                            " << height << '\n';
+    std::cout << "distance of bulletin and camera (m):               " << settings.mDist << '\n';
+    std::cout << "Earth form:                          .  .  .  .  . " << nameForm << ' ' << static_cast<int>(settings.mEarthForm) << '\n';
+    std::cout << "Earth radius (km):                                 " << settings.mEarthRadius << '\n';
+    std::cout << "height of bulletin (m):                            " << settings.mHeight << '\n';
     std::cout << "draw mark across the image: .  .  .  .  .  .  .  . " << paraIm.mMarkAcross << '\n';
     std::cout << "mark indent:                                       " << paraIm.mMarkIndent << '\n';
     std::cout << "draw mark lines in triple width:                   " << paraIm.mMarkTriple << '\n';
     std::cout << "max of cos of direction change to reset big step:  " << std::setprecision(17) << paraRk.mMaxCosDirChange << '\n';
     std::cout << "input filename:                                    " << nameIn << '\n';
+    std::cout << "autotune cache filename:                           " << nameAutotune << '\n';
+    std::cout << "checkpoint journal filename:                       " << nameJournal << '\n';
+    std::cout << "mark overlay filename:                             " << nameMarks << '\n';
     std::cout << "output filename:   .  .  .  .  .  .  .  .  .  .  . " << nameOut << '\n';
+    std::cout << "output filename pattern for sweeps:                " << nameSeries << '\n';
+    std::cout << "tile state filename:                               " << nameState << '\n';
+    std::cout << "solver statistics filename prefix:                 " << nameStats << '\n';
     std::cout << "surface filename:                                  " << nameSurf << '\n';
+    std::cout << "tile filename pattern:                             " << nameTiles << '\n';
+    for(auto const& text : textObjects) {
+      std::cout << "more object name, dist, lift, height, center:       " << text << '\n';
+    }
+    std::cout << "output format:                                     " << nameFormat << ' ' << static_cast<int>(paraIm.mOutputFormat) << '\n';
+    std::cout << "precision away from limits:                        " << namePrecision << ' ' << static_cast<int>(paraIm.mPrecision) << '\n';
+    std::cout << "profile render phases:                             " << paraIm.mProfile << '\n';
     std::cout << "film resolution in X direction (pixel):            " << paraIm.mResolutionX << '\n';
+    std::cout << "region of interest (pixel):                        " << textRoi << '\n';
+    std::cout << "region of interest (degrees):                      " << textRoiAngles << '\n';
+    std::cout << "region of interest zoom:                           " << roiZoom << '\n';
+    std::cout << "server mode:                                       " << serverMode << '\n';
+    std::cout << "irradiance by forward splatting:                   " << splat << '\n';
     std::cout << "initial step size (m):                             " << paraRk.mStep1 << '\n';
+    std::cout << "step sizes from previous ray:                      " << paraIm.mStepHints << '\n';
     std::cout << "minimal step size (m):   .  .  .  .  .  .  .  .  . " << paraRk.mStepMin << '\n';
     std::cout << "maximal step size (m):                             " << paraRk.mStepMax << '\n';
     std::cout << "stepper type:                                      " << nameStepper << ' ' << static_cast<int>(paraRk.mStepper) << '\n';
     std::cout << "subsampling each pixel in both directions (count): " << paraIm.mSubsample << '\n';
-    std::cout << "ambient temperature (Celsius):                     " << tempAmb << '\n';
-    std::cout << "minimum ambient temperature (Celsius):  .  .  .  . " << tempAmbMin << '\n';
-    std::cout << "maximum ambient temperature (Celsius):             " << tempAmbMax << '\n';
-    std::cout << "base temperature, only for water (Celsius):        " << tempBase << '\n';
+    std::cout << "mirror columns of symmetric frames:                " << paraIm.mSymmetry << '\n';
+    for(auto const& sweep : sweeps) {
+      std::cout << "sweep parameter, start, step, count:               " << sweep.mName << ' ' << sweep.mStart << ' ' << sweep.mStep << ' ' << sweep.mCount << '\n';
+    }
+    std::cout << "ambient temperature (Celsius):                     " << settings.mTempAmb << '\n';
+    std::cout << "minimum ambient temperature (Celsius):  .  .  .  . " << settings.mTempAmbMin << '\n';
+    std::cout << "maximum ambient temperature (Celsius):             " << settings.mTempAmbMax << '\n';
+    std::cout << "base temperature, only for water (Celsius):        " << settings.mTempBase << '\n';
+    std::cout << "tile step:                                         " << textTile << '\n';
+    std::cout << "tile worker processes:                             " << tiles << '\n';
+    std::cout << "render time limit (s):                             " << paraIm.mTimeBudget << '\n';
     std::cout << "camera tilt, neg downwards (degrees):      .  .  . " << paraIm.mTilt << '\n';
     std::cout << "absolute tolerance (m):                            " << paraRk.mTolAbs << '\n';
+    std::cout << "tolerance factor away from limits:                 " << paraIm.mTolLoose << '\n';
     std::cout << "relative tolerance (m):                            " << paraRk.mTolRel << '\n';
+    std::cout << "warp frame rate (1/s):                             " << warpFps << '\n';
+    std::cout << "warp input:                                        " << warpIn << '\n';
+    std::cout << "warp output:                                       " << warpOut << '\n';
     uint32_t nCpus = std::thread::hardware_concurrency();
     nCpus -= (nCpus <= paraIm.mRestrictCpu ? nCpus - 1u : paraIm.mRestrictCpu);
     std::cout << "Using " << nCpus << " thread(s)" << std::endl;
   }
   else {} // nothing to do
 
-  paraRk.mDistAlongRay    = dist * 2.0;
-  auto effectiveRadius = (earthForm == Eikonal::EarthForm::cFlat ? std::numeric_limits<double>::infinity() : earthRadius);
+  png::image<png::gray_pixel> billboard(nameIn);
+  if(autotune) {
+    tuneSolver(frames.front(), billboard, autotuneError, nameAutotune);
+    for(auto &frame : frames) {
+      copyTuned(frames.front().mParaRk, frame.mParaRk);
+    }
+    copyTuned(frames.front().mParaRk, unresolved.mParaRk);
+    settings.mParaRk = frames.front().mParaRk;
+    nameStepper = getStepperName(settings.mParaRk.mStepper);  // Server mode interprets it again.
+  }
+  else {} // nothing to do
 
-  Object object(nameIn.c_str(), dist, bullLift, height, effectiveRadius);
-  Medium medium(paraRk, earthForm, earthRadius, base, tempAmb, tempAmbMin, tempAmbMax, tempBase, object);
-  Image image(paraIm, medium);
-  image.process(nameSurf.c_str(), nameOut.c_str());
+  if(serverMode) {
+    settings = unresolved;
+    Server server;
+    std::string line;  // Empty for the initial command line
+    do {
+      auto begin = std::chrono::steady_clock::now();
+      try {
+        opt.parse(line);
+        Server::Request request{settings, nameIn, nameSurf, nameOut, nameMarks};
+        if(opt.count("--server") > 0u || opt.count("--sweep") > 0u) {
+          std::cout << "error --server and --sweep can't be changed" << std::endl;
+        }
+        else if(!interpret(nameBase, nameForm, nameFormat, namePrecision, nameStepper, request.mSettings) || !resolve(request.mSettings)) {
+          std::cout << "error illegal values" << std::endl;
+        }
+        else {
+          auto reshaded = server.serve(request);
+          std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+          std::cout << (reshaded ? "reshaded " : "rendered ") << elapsed.count() << ' ' << nameOut << std::endl;
+        }
+      }
+      catch(std::exception const& e) {
+        std::cout << "error " << e.what() << std::endl;
+      }
+    } while(std::getline(std::cin, line) && line != "quit");
+    return 0;
+  }
+  else {} // nothing to do
+
+  png::image<png::gray_pixel> surface;
+  if(!nameSurf.empty()) {
+    surface.read(nameSurf);
+  }
+  else {} // nothing to do
+
+  if(tiles > 0u) {
+    uint32_t nCpus = std::thread::hardware_concurrency();
+    nCpus -= (nCpus <= paraIm.mRestrictCpu ? nCpus - 1u : paraIm.mRestrictCpu);
+    try {
+      renderTileStep(settings, billboard, surface, TileStep::cPrepare, 0u, tiles, nameState, nameTiles, nameOut, nameMarks);
+      if(!runTileWorkers(aArgc, aArgv, tiles, nCpus)) {
+        return 1;
+      }
+      else {} // nothing to do
+      renderTileStep(settings, billboard, surface, TileStep::cMerge, 0u, tiles, nameState, nameTiles, nameOut, nameMarks);
+    }
+    catch(std::exception const& e) {
+      std::cerr << e.what() << '\n';
+      return 1;
+    }
+    for(uint32_t i = 0u; i < tiles; ++i) {
+      std::remove(formatSeriesName(nameTiles, i).c_str());
+    }
+    std::remove(nameState.c_str());
+  }
+  else if(splat) {
+    try {
+      renderSplat(settings, billboard, nameOut);
+    }
+    catch(std::exception const& e) {
+      std::cerr << e.what() << '\n';
+      return 1;
+    }
+  }
+  else if(!warpIn.empty()) {
+    try {
+      renderWarp(settings, billboard, surface, nameOut, nameMarks, warpIn, warpOut, warpFps);
+    }
+    catch(std::exception const& e) {
+      std::cerr << e.what() << '\n';
+      return 1;
+    }
+  }
+  else if(roi) {
+    try {
+      renderRoi(settings, billboard, *roi, nameOut);
+    }
+    catch(std::exception const& e) {
+      std::cerr << e.what() << '\n';
+      return 1;
+    }
+  }
+  else if(tileStep != TileStep::cNone) {
+    try {
+      renderTileStep(settings, billboard, surface, tileStep, tileIndex, tileCount, nameState, nameTiles, nameOut, nameMarks);
+    }
+    catch(std::exception const& e) {
+      std::cerr << e.what() << '\n';
+      return 1;
+    }
+  }
+  else if(sweeps.empty()) {
+    try {
+      render(settings, billboard, surface, nameOut, nameMarks, nullptr, nameStats, nameJournal);
+    }
+    catch(std::exception const& e) {
+      std::cerr << e.what() << '\n';
+      return 1;
+    }
+  }
+  else {
+    sweep(frames, billboard, surface, nameSeries, nameMarks, silent);
+  }
   return 0;
 }
@@ -7,24 +7,6 @@ double signum(double const aValue) {
   return std::copysign(1.0f, aValue);
 }
 
-double binarySearch(double const aLower, double const aUpper, double const aEpsilon, std::function<bool(double)> aLambda) {
-  bool signLower = aLambda(aLower);
-  double lower = aLower;
-  double upper = aUpper;
-  double result = (lower + upper) / 2.0f;
-  while(upper - lower > aEpsilon) {
-    bool now = aLambda(result);
-    if(now == signLower) {
-      lower = result;
-    }
-    else {
-      upper = result;
-    }
-    result = (lower + upper) / 2.0f;
-  }
-  return result;
-}
-
 PolynomApprox::PolynomApprox(uint32_t const aSampleCount, double const * const aSamplesY, std::initializer_list<PolynomApprox::Var> aVarsX) {
   mTotalCoeffCount = 1u;
   for(auto &var : aVarsX) {
@@ -89,13 +71,13 @@ PolynomApprox::PolynomApprox(uint32_t const aSampleCount, double const * const a
   mRrmsError = (desireds > 0.0f ? ::sqrt(diffs / desireds / aSampleCount) : 0.0f);
 }
 
-double PolynomApprox::eval(std::vector<double> const& aVariables) const {
-  if(aVariables.size() != mVariableCount) {
+double PolynomApprox::eval(double const * const aVariables, uint32_t const aCount) const {
+  if(aCount != mVariableCount) {
     throw std::invalid_argument("eval: variable count mismatch.");
   }
   else {} // nothing to do
   double actualNormalized0 = 0.0;
-  auto arg = aVariables.begin();
+  auto arg = aVariables;
   for(uint32_t v = 0u; v < mVariableCount; ++v) {
     auto normalized = normalize(*arg, v);
     auto& actualPowers = mActualPowers[v];
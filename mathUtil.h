@@ -2,12 +2,31 @@
 #define MATHUTIL_H
 
 #include "Eigen/Dense"
-#include <functional>
 #include <vector>
 #include <array>
+#include <initializer_list>
 
 double signum(double const aValue);
-double binarySearch(double const aLower, double const aUpper, double const aEpsilon, std::function<bool(double)> aLambda);
+
+// aLambda is like bool(double). A template instead of std::function to avoid its heap allocation for big captures.
+template <typename tLambda>
+double binarySearch(double const aLower, double const aUpper, double const aEpsilon, tLambda &&aLambda) {
+  bool signLower = aLambda(aLower);
+  double lower = aLower;
+  double upper = aUpper;
+  double result = (lower + upper) / 2.0f;
+  while(upper - lower > aEpsilon) {
+    bool now = aLambda(result);
+    if(now == signLower) {
+      lower = result;
+    }
+    else {
+      upper = result;
+    }
+    result = (lower + upper) / 2.0f;
+  }
+  return result;
+}
 
 class PolynomApprox final {
 public:
@@ -41,15 +60,12 @@ public:
 
   double getRrmsError() const { return mRrmsError; }
 
-  double eval(std::initializer_list<double> const& aVariables) const {
-    std::vector<double> variables;  // Hope they fit in the default reserve. Probabaly yes.
-    for(auto d : aVariables) {
-      variables.push_back(d);
-    }
-    return eval(variables);
-  }
+  double eval(std::initializer_list<double> const& aVariables) const { return eval(aVariables.begin(), aVariables.size()); }
+
+  double eval(std::vector<double> const& aVariables) const { return eval(aVariables.data(), aVariables.size()); }
 
-  double eval(std::vector<double> const& aVariables) const;
+  // Does not allocate, the intermediate results go to the mutable members.
+  double eval(double const * const aVariables, uint32_t const aCount) const;
 
   double eval(double const aX) const { return eval(normalize(aX, 0u), 0u); }
 
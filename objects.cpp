@@ -0,0 +1,81 @@
+#include "simpleRaytracer.h"
+#include "CLI.hpp"
+#include <filesystem>
+#include <iostream>
+
+
+// Renders the reference scene of regression with round Earth over water alone, and again with a nearer object
+// above all rays but within the culling margin, so Medium::traceObjects watches its plane for each ray. As the
+// object is never hit, both renders must be identical, because the plane must not disturb the rays missing it.
+int main(int aArgc, char **aArgv) {
+  RungeKuttaRayBending::Parameters paraRk;
+  Image::Parameters paraIm;
+
+  CLI::App opt{"Usage"};
+  std::string nameDir = "golden";
+  opt.add_option("--dir", nameDir, "directory of the outputs [golden]");
+  std::string nameIn = "monoscopeRca.png";
+  opt.add_option("--nameIn", nameIn, "billboard filename [monoscopeRca.png]");
+  paraIm.mResolutionX = 120u;
+  opt.add_option("--resolution", paraIm.mResolutionX, "film resolution in X direction (pixel) [120]");
+  CLI11_PARSE(opt, aArgc, aArgv);
+
+  double const cEarthRadius = 6371000.0;
+  double const cDist = 1000.0;
+  double const cHeight = 9.0;
+  double const cNearDist = 300.0;
+  double const cNearLift = 5.0;
+  double const cNearHeight = 1.0;
+  paraRk.mStepper         = StepperType::cRungeKuttaFehlberg45;
+  paraRk.mDistAlongRay    = cDist * 2.0;
+  paraRk.mTolAbs          = 0.001;
+  paraRk.mTolRel          = 0.001;
+  paraRk.mStep1           = 0.01;
+  paraRk.mStepMin         = 1e-4;
+  paraRk.mStepMax         = 55.5;
+  paraRk.mMaxCosDirChange = 0.99999999999;
+  paraIm.mRestrictCpu     = 0u;
+  paraIm.mThreadCount     = 1u;
+  paraIm.mCamCenter       = 1.1;
+  paraIm.mTilt            = 0.0;
+  paraIm.mBorderFactor    = 0.05;
+  paraIm.mSubsample       = 1u;
+  paraIm.mMarkIndent      = 0.9;
+  paraIm.mMarkAcross      = false;
+  paraIm.mMarkTriple      = false;
+  paraIm.mOutputFormat    = Image::OutputFormat::cIndexed8;
+  paraIm.mRetainHits      = false;
+  paraIm.mTimeBudget      = 0.0;
+  paraIm.mProfile         = false;
+  paraIm.mStepHints       = true;
+  paraIm.mSymmetry        = true;
+  paraIm.mTolLoose        = 1.0;
+  paraIm.mPrecision       = RungeKuttaRayBending::Precision::cDouble;
+
+  png::image<png::gray_pixel> billboard(nameIn);
+  Object object(billboard, cDist, 0.0, cHeight, cEarthRadius);
+  Object near(billboard, cNearDist, cNearLift, cNearHeight, cEarthRadius);
+  Medium alone(paraRk, Eikonal::EarthForm::cRound, cEarthRadius, Eikonal::Model::cWater, 10.0, 8.0, 14.0, 13.0, object);
+  Medium scene(paraRk, Eikonal::EarthForm::cRound, cEarthRadius, Eikonal::Model::cWater, 10.0, 8.0, 14.0, 13.0, object, { &near });
+  std::filesystem::create_directories(nameDir);
+  auto nameAlone = nameDir + "/objects-alone.current.png";
+  auto nameScene = nameDir + "/objects-near.current.png";
+  Image(paraIm, alone).process(png::image<png::gray_pixel>(), nameAlone.c_str(), "");
+  Image(paraIm, scene).process(png::image<png::gray_pixel>(), nameScene.c_str(), "");
+
+  png::image<png::index_pixel> imageAlone(nameAlone);
+  png::image<png::index_pixel> imageScene(nameScene);
+  uint32_t differing = 0u;
+  for(uint32_t y = 0u; y < imageAlone.get_height(); ++y) {
+    for(uint32_t x = 0u; x < imageAlone.get_width(); ++x) {
+      differing += (imageAlone.get_pixel(x, y) != imageScene.get_pixel(x, y) ? 1u : 0u);
+    }
+  }
+  bool passed = (differing == 0u);
+  if(!passed) {
+    std::cerr << "The object never hit changed " << differing << " pixels of " << nameAlone << " in " << nameScene << ".\n";
+  }
+  else {} // nothing to do
+  std::cout << (passed ? "PASSED" : "FAILED") << '\n';
+  return passed ? 0 : 1;
+}
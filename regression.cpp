@@ -0,0 +1,215 @@
+#include "simpleRaytracer.h"
+#include "CLI.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+
+// Small reference scenes rendered with the main defaults, so they follow the solver as used.
+struct Scene {
+  std::string         mName;
+  Eikonal::EarthForm  mEarthForm;
+  Eikonal::Model      mModel;
+  double              mTempAmb;
+  double              mTempAmbMin;
+  double              mTempAmbMax;
+  double              mTempBase;
+  bool                mSurface;
+};
+
+struct Outcome {
+  uint32_t mPixels;
+  uint32_t mOutliers;       // pixels differing more than the tolerance
+  int      mMaxDiff;
+  double   mWallSeconds;
+  double   mRaysPerSecond;
+};
+
+struct Baseline {
+  double mWallSeconds;
+  double mRaysPerSecond;
+};
+
+std::vector<Scene> getScenes() {
+  std::vector<Scene> result;
+  for(auto form : { Eikonal::EarthForm::cFlat, Eikonal::EarthForm::cRound }) {
+    // Temperatures of the main defaults, with limits around them where the main defaults would not fit.
+    std::array<std::tuple<Eikonal::Model, char const*, std::array<double, 4u>>, 3u> const models {{
+      { Eikonal::Model::cWater,        "water",        { 10.0,  8.0, 14.0, 13.0 } },
+      { Eikonal::Model::cConventional, "conventional", { 20.0, 15.0, 25.0, 20.0 } },
+      { Eikonal::Model::cPorous,       "porous",       { 38.5, 33.0, 44.0, 38.5 } }
+    }};
+    for(auto const& [model, name, temps] : models) {
+      for(auto surface : { false, true }) {
+        result.push_back({ std::string(form == Eikonal::EarthForm::cFlat ? "flat-" : "round-") + name + (surface ? "-surf" : ""),
+                           form, model, temps[0], temps[1], temps[2], temps[3], surface });
+      }
+    }
+  }
+  return result;
+}
+
+// Fastest of aRepeat renders into aNameOut.
+Outcome render(Scene const& aScene, RungeKuttaRayBending::Parameters aParaRk, Image::Parameters const& aParaIm, uint32_t const aRepeat,
+               png::image<png::gray_pixel> const& aBillboard, png::image<png::gray_pixel> const& aSurface, std::string const& aNameOut) {
+  double const cEarthRadius = 6371000.0;
+  double const cDist = 1000.0;
+  double const cHeight = 9.0;
+  aParaRk.mDistAlongRay = cDist * 2.0;
+  auto effectiveRadius = (aScene.mEarthForm == Eikonal::EarthForm::cFlat ? std::numeric_limits<double>::infinity() : cEarthRadius);
+  Object object(aBillboard, cDist, 0.0, cHeight, effectiveRadius);
+  Medium medium(aParaRk, aScene.mEarthForm, cEarthRadius, aScene.mModel, aScene.mTempAmb, aScene.mTempAmbMin, aScene.mTempAmbMax, aScene.mTempBase, object);
+  Outcome result{ 0u, 0u, 0, std::numeric_limits<double>::max(), 0.0 };
+  for(uint32_t r = 0u; r < aRepeat; ++r) {
+    auto begin = std::chrono::steady_clock::now();
+    Image image(aParaIm, medium);
+    image.process(aScene.mSurface ? aSurface : png::image<png::gray_pixel>(), aNameOut.c_str(), "");
+    result.mWallSeconds = std::min(result.mWallSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+    result.mRaysPerSecond = std::max(result.mRaysPerSecond, image.getMirageRayCount() / image.getMirageSeconds());
+  }
+  return result;
+}
+
+// Compares palette indices, because marks and texels share the index space.
+bool compare(std::string const& aNameGolden, std::string const& aNameCurrent, int const aTolerance, Outcome &aOutcome) {
+  png::image<png::index_pixel> golden(aNameGolden);
+  png::image<png::index_pixel> current(aNameCurrent);
+  bool result = golden.get_width() == current.get_width() && golden.get_height() == current.get_height();
+  if(result) {
+    aOutcome.mPixels = golden.get_width() * golden.get_height();
+    for(uint32_t y = 0u; y < golden.get_height(); ++y) {
+      for(uint32_t x = 0u; x < golden.get_width(); ++x) {
+        int diff = std::abs(static_cast<int>(golden.get_pixel(x, y)) - static_cast<int>(current.get_pixel(x, y)));
+        aOutcome.mMaxDiff = std::max(aOutcome.mMaxDiff, diff);
+        aOutcome.mOutliers += (diff > aTolerance ? 1u : 0u);
+      }
+    }
+  }
+  else {} // nothing to do
+  return result;
+}
+
+std::map<std::string, Baseline> loadBaseline(std::string const& aName) {
+  std::map<std::string, Baseline> result;
+  std::ifstream in(aName);
+  std::string line;
+  while(std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string name;
+    Baseline baseline;
+    if(fields >> name >> baseline.mWallSeconds >> baseline.mRaysPerSecond) {
+      result[name] = baseline;
+    }
+    else {} // nothing to do
+  }
+  return result;
+}
+
+int main(int aArgc, char **aArgv) {
+  RungeKuttaRayBending::Parameters paraRk;
+  Image::Parameters paraIm;
+
+  CLI::App opt{"Usage"};
+  std::string nameDir = "golden";
+  opt.add_option("--dir", nameDir, "directory of the golden images, the baseline and the current outputs [golden]");
+  double maxOutliers = 0.001;
+  opt.add_option("--maxOutliers", maxOutliers, "maximal ratio of pixels differing more than the tolerance [0.001]");
+  std::string nameIn = "monoscopeRca.png";
+  opt.add_option("--nameIn", nameIn, "billboard filename [monoscopeRca.png]");
+  std::string nameSurf = "water.png";
+  opt.add_option("--nameSurf", nameSurf, "surface filename for the scenes with surface [water.png]");
+  uint32_t repeat = 3u;
+  opt.add_option("--repeat", repeat, "renders of each scene, the fastest counts (count) [3]");
+  paraIm.mResolutionX = 120u;
+  opt.add_option("--resolution", paraIm.mResolutionX, "film resolution in X direction (pixel) [120]");
+  double slowdown = 0.15;
+  opt.add_option("--slowdown", slowdown, "maximal relative loss in rays per second or wall time compared to the baseline [0.15]");
+  paraIm.mThreadCount = 1u;
+  opt.add_option("--threads", paraIm.mThreadCount, "threads for rendering, 0 means all CPUs (count) [1]");
+  int tolerance = 2;
+  opt.add_option("--tolerance", tolerance, "maximal difference of palette indices for a pixel to count as equal [2]");
+  bool update = false;
+  opt.add_option("--update", update, "store the current outputs as golden images and the current speed as baseline (true, false) [false]");
+  CLI11_PARSE(opt, aArgc, aArgv);
+
+  paraRk.mStepper         = StepperType::cRungeKuttaFehlberg45;
+  paraRk.mTolAbs          = 0.001;
+  paraRk.mTolRel          = 0.001;
+  paraRk.mStep1           = 0.01;
+  paraRk.mStepMin         = 1e-4;
+  paraRk.mStepMax         = 55.5;
+  paraRk.mMaxCosDirChange = 0.99999999999;
+  paraIm.mRestrictCpu     = 0u;
+  paraIm.mCamCenter       = 1.1;
+  paraIm.mTilt            = 0.0;
+  paraIm.mBorderFactor    = 0.05;
+  paraIm.mSubsample       = 1u;
+  paraIm.mMarkIndent      = 0.9;
+  paraIm.mMarkAcross      = false;
+  paraIm.mMarkTriple      = false;
+  paraIm.mOutputFormat    = Image::OutputFormat::cIndexed8;
+  paraIm.mRetainHits      = false;
+  paraIm.mTimeBudget      = 0.0;
+  paraIm.mProfile         = false;
+  paraIm.mStepHints       = true;
+  paraIm.mSymmetry        = true;
+  paraIm.mTolLoose        = 1.0;
+  paraIm.mPrecision       = RungeKuttaRayBending::Precision::cDouble;
+
+  png::image<png::gray_pixel> billboard(nameIn);
+  png::image<png::gray_pixel> surface(nameSurf);
+  std::filesystem::create_directories(nameDir);
+  auto nameBaseline = nameDir + "/baseline.txt";
+  auto baselines = loadBaseline(nameBaseline);
+  std::ofstream newBaseline;
+  if(update) {
+    newBaseline.open(nameBaseline);
+  }
+  else {} // nothing to do
+
+  bool passed = true;
+  std::cout << std::setw(24) << std::left << "scene" << std::right << std::setw(10) << "outliers" << std::setw(8) << "maxDiff"
+            << std::setw(12) << "wall (s)" << std::setw(12) << "rays/s" << std::setw(19) << "speed vs baseline" << "  verdict\n";
+  for(auto const& scene : getScenes()) {
+    auto nameGolden = nameDir + '/' + scene.mName + ".png";
+    auto nameCurrent = nameDir + '/' + scene.mName + ".current.png";
+    auto outcome = render(scene, paraRk, paraIm, repeat, billboard, surface, update ? nameGolden : nameCurrent);
+    std::string verdict = "ok";
+    double speed = std::nan("");
+    if(update) {
+      newBaseline << scene.mName << ' ' << std::setprecision(9) << outcome.mWallSeconds << ' ' << outcome.mRaysPerSecond << '\n';
+      verdict = "updated";
+    }
+    else if(!std::filesystem::exists(nameGolden)) {
+      verdict = "FAIL no golden image, run with --update true on a trusted build";
+    }
+    else if(!compare(nameGolden, nameCurrent, tolerance, outcome)) {
+      verdict = "FAIL size differs";
+    }
+    else if(outcome.mOutliers > maxOutliers * outcome.mPixels) {
+      verdict = "FAIL accuracy";
+    }
+    else {
+      auto found = baselines.find(scene.mName);
+      if(found != baselines.end()) {
+        speed = outcome.mRaysPerSecond / found->second.mRaysPerSecond;
+        if(speed < 1.0 - slowdown || outcome.mWallSeconds > found->second.mWallSeconds * (1.0 + slowdown)) {
+          verdict = "FAIL slowdown";
+        }
+        else {} // nothing to do
+      }
+      else {
+        verdict = "FAIL no baseline, run with --update true on a trusted build";
+      }
+    }
+    passed = passed && (update || verdict.compare(0u, 2u, "ok") == 0);
+    std::cout << std::setw(24) << std::left << scene.mName << std::right << std::setw(10) << outcome.mOutliers << std::setw(8) << outcome.mMaxDiff
+              << std::fixed << std::setprecision(3) << std::setw(12) << outcome.mWallSeconds << std::setprecision(0) << std::setw(12) << outcome.mRaysPerSecond
+              << std::setprecision(3) << std::setw(19) << speed << std::defaultfloat << "  " << verdict << std::endl;
+  }
+  std::cout << (passed ? "PASSED" : "FAILED") << '\n';
+  return passed ? 0 : 1;
+}
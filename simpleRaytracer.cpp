@@ -1,27 +1,150 @@
 #include "simpleRaytracer.h"
+#include "BatchTracer.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
 #include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
-Object::Object(char const * const aName, double const aDispX, double const aLiftY, double const aHeight, double const aEarthRadius)
-  : mImage(aName)
+namespace {
+
+void appendLittleEndian(std::vector<char> &aBytes, uint32_t const aValue) {
+  for(uint32_t i = 0u; i < 4u; ++i) {
+    aBytes.push_back(static_cast<char>((aValue >> (i * 8u)) & 0xffu));
+  }
+}
+
+void appendLittleEndian(std::vector<char> &aBytes, float const aValue) {
+  uint32_t bits;
+  std::memcpy(&bits, &aValue, sizeof(bits));
+  appendLittleEndian(aBytes, bits);
+}
+
+void appendLittleEndian(std::vector<char> &aBytes, uint64_t const aValue) {
+  appendLittleEndian(aBytes, static_cast<uint32_t>(aValue & 0xffffffffu));
+  appendLittleEndian(aBytes, static_cast<uint32_t>(aValue >> 32u));
+}
+
+void appendLittleEndian(std::vector<char> &aBytes, double const aValue) {
+  uint64_t bits;
+  std::memcpy(&bits, &aValue, sizeof(bits));
+  appendLittleEndian(aBytes, bits);
+}
+
+uint32_t readLittleEndian(char const * const aBytes) {
+  uint32_t result = 0u;
+  for(uint32_t i = 0u; i < 4u; ++i) {
+    result |= static_cast<uint32_t>(static_cast<uint8_t>(aBytes[i])) << (i * 8u);
+  }
+  return result;
+}
+
+uint64_t readLittleEndian64(char const * const aBytes) {
+  return readLittleEndian(aBytes) | static_cast<uint64_t>(readLittleEndian(aBytes + 4u)) << 32u;
+}
+
+double readLittleEndianDouble(char const * const aBytes) {
+  uint64_t bits = readLittleEndian64(aBytes);
+  double result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+uint32_t getChecksum(char const * const aBytes, size_t const aSize) {
+  uint32_t result = 2166136261u;  // FNV-1a
+  for(size_t i = 0u; i < aSize; ++i) {
+    result = (result ^ static_cast<uint8_t>(aBytes[i])) * 16777619u;
+  }
+  return result;
+}
+
+bool writeAll(int const aFile, char const * aBytes, size_t aSize) {
+  while(aSize > 0u) {
+    auto written = ::write(aFile, aBytes, aSize);
+    if(written < 0 && errno != EINTR) {
+      return false;
+    }
+    else if(written > 0) {
+      aBytes += written;
+      aSize -= written;
+    }
+    else {} // nothing to do
+  }
+  return true;
+}
+
+}
+
+
+Object::Object(png::image<png::gray_pixel> const &aImage, double const aDispX, double const aLiftY, double const aHeight, double const aEarthRadius,
+               double const aCenterZ)
+  : mImage(aImage)
   , mDy(aHeight / mImage.get_height())
   , mDz(mDy)
   , mMinY(aLiftY)
   , mMaxY(aLiftY + aHeight)
-  , mMinZ(-static_cast<double>(mImage.get_width()) * aHeight / static_cast<double>(mImage.get_height()) / 2.0)
-  , mMaxZ(-mMinZ)
+  , mMinZ(aCenterZ - static_cast<double>(mImage.get_width()) * aHeight / static_cast<double>(mImage.get_height()) / 2.0)
+  , mMaxZ(aCenterZ + static_cast<double>(mImage.get_width()) * aHeight / static_cast<double>(mImage.get_height()) / 2.0)
   , mX(aDispX) {
   double shift = (std::isinf(aEarthRadius) ? 0.0 : std::sqrt(aEarthRadius * aEarthRadius - mX * mX) - aEarthRadius);
   mMinY += shift;
   mMaxY += shift;
 }
 
+bool Object::replaceImage(png::image<png::gray_pixel> const &aImage) {
+  bool result = (aImage.get_width() == mImage.get_width() && aImage.get_height() == mImage.get_height());
+  if(result) {
+    mImage = aImage;
+  }
+  else {} // nothing to do
+  return result;
+}
+
 bool Object::hasPixel(Vertex const &aHit) const {
   return aHit(1) > mMinY && aHit(1)  < mMaxY && aHit(2) > mMinZ && aHit(2) < mMaxZ;
 }
 
+bool Object::mayCross(Vertex const &aStart, Vector const &aDirection) const {
+  bool result = false;
+  if(aDirection(0) > 0.0 && mX > aStart(0)) {
+    double const distance = mX - aStart(0);
+    double const margin = csCullSlope * distance;
+    double const y = aStart(1) + distance * aDirection(1) / aDirection(0);
+    double const z = aStart(2) + distance * aDirection(2) / aDirection(0);
+    result = y + margin > mMinY && y - margin < mMaxY && z + margin > mMinZ && z - margin < mMaxZ;
+  }
+  else {} // nothing to do
+  return result;
+}
+
+double Object::getTexelMargin(Vertex const &aHit) const {
+  auto x = (aHit(2) - mMinZ) / mDz;
+  auto y = (aHit(1) - mMinY) / mDy;
+  return std::min(std::abs(x - std::floor(x) - 0.5), std::abs(y - std::floor(y) - 0.5));
+}
+
+uint32_t Object::getTexelIndex(Vertex const &aHit) const {
+  uint32_t result = getTexelCount();
+  int32_t x = static_cast<int32_t>(::round((aHit(2) - mMinZ) / mDz));
+  int32_t y = static_cast<int32_t>(::round(mImage.get_height() - (aHit(1) - mMinY) / mDy - 1u));
+  if(x >= 0 && y >= 0 && x < mImage.get_width() && y < mImage.get_height()) {
+    result = x + y * mImage.get_width();
+  }
+  else {} // nothing to do
+  return result;
+}
+
 uint8_t Object::getPixel(Vertex const &aHit) const {
   uint8_t result = 0u;
   int32_t x = static_cast<int32_t>(::round((aHit(2) - mMinZ) / mDz));
@@ -37,18 +160,105 @@ uint8_t Object::getPixel(Vertex const &aHit) const {
 }
 
 
+Medium::Medium(Medium const& aOther, double const aLooseFactor, RungeKuttaRayBending::Precision const aPrecision)
+  : mParameters([&aOther, aLooseFactor, aPrecision]() {
+      auto result = aOther.mParameters;
+      result.mTolAbs    *= aLooseFactor;
+      result.mTolRel    *= aLooseFactor;
+      result.mStep1     *= aLooseFactor;
+      result.mPrecision  = aPrecision;
+      return result;
+    }())
+  , mEikonal(aOther.mEikonal)
+  , mSolver(mParameters, mEikonal)
+  , mObject(aOther.mObject)
+  , mObjects(aOther.mObjects) {
+  mWindows.reserve(mObjects.size());
+}
+
+Medium::Medium(RungeKuttaRayBending::Parameters const& aParameters,
+               Eikonal::EarthForm const aEarthForm, double const aEarthRadius, Eikonal::Model const aModel,
+               double const aTempAmbient, double const tempAmbMin, double const tempAmbMax, double const aTempBase, Object const& aObject,
+               std::vector<Object const*> const& aOthers)
+  : mParameters(aParameters)
+  , mEikonal(aEarthForm, aEarthRadius, aModel, aTempAmbient, tempAmbMin, tempAmbMax, aTempBase)
+  , mSolver(aParameters, mEikonal)
+  , mObject(aObject)
+  , mObjects(aOthers) {
+  mObjects.push_back(&aObject);
+  std::stable_sort(mObjects.begin(), mObjects.end(), [](Object const* aA, Object const* aB) { return aA->getX() < aB->getX(); });
+  mWindows.reserve(mObjects.size());
+}
+
+bool Medium::isSymmetric() const {
+  bool result = true;
+  for(auto object : mObjects) {
+    result = result && object->isCentered();
+  }
+  return result;
+}
+
+// A hit stops just past the plane of its object, so only the objects of the nearest plane before it are candidates.
+Object const* Medium::findObject(Vertex const& aHit) const {
+  Object const* result = nullptr;
+  if(mObjects.size() == 1u) {
+    result = &mObject;
+  }
+  else {
+    uint32_t end = std::upper_bound(mObjects.begin(), mObjects.end(), aHit(0), [](double const aX, Object const* aObject) { return aX < aObject->getX(); }) - mObjects.begin();
+    for(uint32_t i = end; i > 0u && mObjects[i - 1u]->getX() == mObjects[end - 1u]->getX() && result == nullptr; --i) {
+      result = (mObjects[i - 1u]->hasPixel(aHit) ? mObjects[i - 1u] : nullptr);
+    }
+  }
+  return result;
+}
+
+// One integration along the ray to the farthest plane, ended early where it crosses an object. The billboard
+// is always traced like without other objects, the others are culled by Object::mayCross. If the ray ended
+// only near an object, it goes on from there with the same momentum and the step size reached before.
+RungeKuttaRayBending::Result Medium::traceObjects(Ray const& aRay, uint32_t const aMaxStep, RungeKuttaRayBending::StepSchedule const * const aHint) {
+  mWindows.clear();
+  for(auto object : mObjects) {
+    if(object == &mObject || object->mayCross(aRay.mStart, aRay.mDirection)) {
+      mWindows.push_back(object->getWindow());
+    }
+    else {} // nothing to do
+  }
+  double const x = mWindows.back().mX;
+  auto state = mSolver.getState(aRay.mStart, aRay.mDirection);
+  auto result = mSolver.solve4x(state, x, aMaxStep, aHint, mWindows.data(), mWindows.size());
+  uint32_t steps = result.mStepCount;
+  uint32_t first = 0u;
+  while(result.mValid && result.mValue(0) < x && findObject(result.mValue) == nullptr && steps < aMaxStep) {
+    for(; first < mWindows.size() && mWindows[first].mX <= result.mValue(0); ++first) {}
+    RungeKuttaRayBending::StepSchedule resume;
+    resume.mSteps[0u] = *std::max_element(result.mSchedule.mSteps.begin(), result.mSchedule.mSteps.begin() + result.mSchedule.mCount);
+    resume.mCount = 1u;
+    result = mSolver.solve4x(state, x, aMaxStep - steps, &resume, mWindows.data() + first, mWindows.size() - first);
+    steps += result.mStepCount;
+  }
+  result.mStepCount = steps;
+  return result;
+}
+
 uint8_t Medium::trace(Ray const& aRay) {
+  RungeKuttaRayBending::Result hit;
+  return trace(aRay, hit);
+}
+
+uint8_t Medium::trace(Ray const& aRay, RungeKuttaRayBending::Result &aHit, uint32_t const aMaxStep, RungeKuttaRayBending::StepSchedule const * const aHint) {
   try {
-    auto hit = mSolver.solve4x(aRay.mStart, aRay.mDirection, mObject.getX());
-    if(hit.mValid) {
-      return mObject.getPixel(hit.mValue);
+    aHit = (mObjects.size() == 1u ? mSolver.solve4x(aRay.mStart, aRay.mDirection, mObject.getX(), aMaxStep, aHint) : traceObjects(aRay, aMaxStep, aHint));
+    if(aHit.mValid) {
+      return getPixel(aHit.mValue);
     }
     else {
       return 0;
     }
   }
   catch(...) {
-std::cout << aRay.mStart(0) << ' ' << aRay.mStart(1) << ' ' << aRay.mStart(2) << ' '
+    SOLVER_STATISTICS_ADD(cExceptions, 1u);
+std::cerr << aRay.mStart(0) << ' ' << aRay.mStart(1) << ' ' << aRay.mStart(2) << ' '
           << aRay.mDirection(0) << ' ' << aRay.mDirection(1) << ' ' << aRay.mDirection(2) << '\n';
     throw 0;
   }
@@ -60,7 +270,8 @@ bool Medium::hits(Ray const& aRay) {
     return hit.mValid && mObject.hasPixel(hit.mValue);
   }
   catch(...) {
-std::cout << aRay.mStart(0) << ' ' << aRay.mStart(1) << ' ' << aRay.mStart(2) << ' '
+    SOLVER_STATISTICS_ADD(cExceptions, 1u);
+std::cerr << aRay.mStart(0) << ' ' << aRay.mStart(1) << ' ' << aRay.mStart(2) << ' '
           << aRay.mDirection(0) << ' ' << aRay.mDirection(1) << ' ' << aRay.mDirection(2) << '\n';
     return false;
   }
@@ -69,6 +280,16 @@ std::cout << aRay.mStart(0) << ' ' << aRay.mStart(1) << ' ' << aRay.mStart(2) <<
 
 Image::Image(Parameters const& aPara, Medium &aMedium)
   : mRestrictCpu(aPara.mRestrictCpu)
+  , mThreadCount(aPara.mThreadCount)
+  , mRetainHits(aPara.mRetainHits)
+  , mTimeBudget(aPara.mTimeBudget)
+  , mProfile(aPara.mProfile)
+  , mStepHints(aPara.mStepHints)
+  , mSymmetry(aPara.mSymmetry)
+  , mTolLoose(aPara.mTolLoose)
+  , mPrecision(aPara.mPrecision)
+  , mPool(getThreadCount())
+  , mOutputFormat(aPara.mOutputFormat)
   , mPalette(256)
   , mResolutionX(aPara.mResolutionX)
   , mBorderFactor(aPara.mBorderFactor)
@@ -92,76 +313,493 @@ Image::Image(Parameters const& aPara, Medium &aMedium)
   mImage.set_palette(mPalette);
 }
 
-void Image::process(char const * const aNameSurf, char const * const aNameOut) {
-  calculateAngleLimits(Eikonal::Temperature::cAmbient);
-  calculateAngleLimits(Eikonal::Temperature::cBase);
-  calculateAngleLimits(Eikonal::Temperature::cMinimum);
-  calculateAngleLimits(Eikonal::Temperature::cMaximum);
-  calculateBiases(*aNameSurf != 0);
+void Image::process(char const * const aNameSurf, char const * const aNameOut, char const * const aNameMarks) {
+  png::image<png::gray_pixel> surface;
+  processPhases(*aNameSurf != 0, [&surface, aNameSurf]{ surface.read(aNameSurf); }, surface, aNameOut, aNameMarks);
+}
+
+void Image::process(png::image<png::gray_pixel> const &aSurface, char const * const aNameOut, char const * const aNameMarks) {
+  processPhases(aSurface.get_width() > 0u, nullptr, aSurface, aNameOut, aNameMarks);
+}
+
+// Each phase waits only for what it reads. The surface and the mirror height write different data, so they
+// overlap after the limits, sharing the threads of the image. The mirage follows them on all the threads,
+// overlapping only the marks.
+void Image::processPhases(bool const aRenderSurface, std::function<void()> const& aLoad, png::image<png::gray_pixel> const &aSurface,
+                          char const * const aNameOut, char const * const aNameMarks) {
+  mDeadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(mTimeBudget));
+  mUnderRefined.clear();
+  mProfiler.reset(mProfile, getThreadCount());
+  bool resumed = false;
+  if(!mNameJournal.empty()) {
+    mProfiler.measure("journal", [this, aRenderSurface, &resumed]{ resumed = readJournalHeader(aRenderSurface); });
+  }
+  else {} // nothing to do
+  // The surface overlaps the mirror height and the mirage, which share the rest of the threads.
+  uint32_t const threadCount = getThreadCount();
+  uint32_t const surfaceThreads = std::max(1u, threadCount / csSurfThreadShare);
+  uint32_t const otherThreads = std::max(1u, threadCount - (aRenderSurface ? surfaceThreads : 0u));
+  TaskGraph graph;
+  auto load = (aLoad ? graph.add([this, &aLoad]{ mProfiler.measure("load surface", aLoad); }) : TaskGraph::csNone);
+  auto geometry = (resumed ? TaskGraph::csNone : addGeometry(graph, aRenderSurface));
+  auto surface = TaskGraph::csNone;
+  if(aRenderSurface) {
+    surface = graph.add([this, &aSurface, surfaceThreads]{
+      mProfiler.measure("surface", [this, &aSurface, surfaceThreads]{ renderSurface(aSurface, surfaceThreads); });
+    }, { load, geometry });
+  }
+  else {} // nothing to do
+  auto mirror = TaskGraph::csNone;
+  if(!resumed) {
+    mirror = graph.add([this, otherThreads]{
+      mProfiler.measure("mirror height", [this, otherThreads]{ mMirrorHeight = calculateMirrorHeight(otherThreads); });
+    }, { geometry });
+  }
+  else {} // nothing to do
+  auto journal = TaskGraph::csNone;
+  if(!mNameJournal.empty() && !resumed) {
+    journal = graph.add([this, aRenderSurface]{ mProfiler.measure("journal", [this, aRenderSurface]{ writeJournalHeader(aRenderSurface); }); }, { mirror });
+  }
+  else {} // nothing to do
+  auto mirage = graph.add([this, otherThreads]{
+    mMirageBottom  = mLimitPixelBottom;
+    mMirageTop     = mLimitPixelTop;
+    mMirageDeep    = mLimitPixelDeep;
+    mMirageShallow = mLimitPixelShallow;
+    mProfiler.measure("mirage", [this, otherThreads]{ calculateMirage(otherThreads); });
+  }, { geometry, journal, mirror });
+  auto marks = graph.add([this]{ mProfiler.measure("marks", [this]{ drawMarks(mMirrorHeight); }); }, { geometry, mirror });
+  graph.add([this, aNameOut, aNameMarks]{ mProfiler.measure("write", [this, aNameOut, aNameMarks]{ write(aNameOut, aNameMarks); }); },
+            { surface, mirage, marks });
+  graph.run(mPool);
+}
+
+// The critical angles of the four temperatures are scanned concurrently, each on its own medium,
+// then the rest of the limits follows in one task.
+TaskGraph::Id Image::addGeometry(TaskGraph &aGraph, bool const aRenderSurface) {
+  mAngleScans.fill(AngleScan{});
+  std::vector<TaskGraph::Id> scans;
+  for(auto which : { Eikonal::Temperature::cAmbient, Eikonal::Temperature::cBase, Eikonal::Temperature::cMinimum, Eikonal::Temperature::cMaximum }) {
+    scans.push_back(aGraph.add([this, which]{
+      mProfiler.measure("critical angles", [this, which]{
+        Medium medium(mMedium);
+        medium.setWaterTempAmb(which);
+        auto index = static_cast<uint32_t>(which);
+        mAngleScans[index].mCriticals = scanCriticals(medium, mHints.mCriticals[index]);
+        mHints.mCriticals[index] = *mAngleScans[index].mCriticals;
+      });
+    }));
+  }
+  return aGraph.add([this, aRenderSurface]{ calculateGeometry(aRenderSurface); }, scans);
+}
+
+// Limits and mirror height for the steps not overlapping them with the mirage.
+void Image::calculateLimits(bool const aRenderSurface) {
+  TaskGraph graph;
+  auto geometry = addGeometry(graph, aRenderSurface);
+  graph.add([this]{ mProfiler.measure("mirror height", [this]{ mMirrorHeight = calculateMirrorHeight(getThreadCount()); }); }, { geometry });
+  graph.run(mPool);
+}
+
+void Image::calculateGeometry(bool const aRenderSurface) {
+  mProfiler.measure("angle limits ambient", [this]{ calculateAngleLimits(Eikonal::Temperature::cAmbient); });
+  mProfiler.measure("angle limits base",    [this]{ calculateAngleLimits(Eikonal::Temperature::cBase); });
+  mProfiler.measure("angle limits minimum", [this]{ calculateAngleLimits(Eikonal::Temperature::cMinimum); });
+  mProfiler.measure("angle limits maximum", [this]{ calculateAngleLimits(Eikonal::Temperature::cMaximum); });
+  mProfiler.measure("biases", [this, aRenderSurface]{ calculateBiases(aRenderSurface); });
   mLimitAngleTop.reset();
   mLimitAngleBottom.reset();
-  calculateAngleLimits(Eikonal::Temperature::cAmbient);
-  mLimitPixelTop        = calculatePixelLimitY(*mLimitAngleTop);
-  mLimitPixelBottom     = calculatePixelLimitY(*mLimitAngleBottom) + 1;
+  mProfiler.measure("angle limits ambient", [this]{ calculateAngleLimits(Eikonal::Temperature::cAmbient); });
+  mProfiler.measure("pixel limits", [this]{
+    mLimitPixelTop        = calculatePixelLimitY(*mLimitAngleTop);
+    mLimitPixelBottom     = calculatePixelLimitY(*mLimitAngleBottom) + 1;
+  });
   mLimitAngleTop.reset();
   mLimitAngleBottom.reset();
-  calculateAngleLimits(Eikonal::Temperature::cBase);
-  mLimitPixelBaseTop        = calculatePixelLimitY(*mLimitAngleTop);
-  mLimitPixelBaseBottom     = calculatePixelLimitY(*mLimitAngleBottom);
-  mLimitPixelBaseBottomSurf = calculatePixelLimitY(mLimitAngleBottomSurf);
-  calculateAngleLimits(Eikonal::Temperature::cMinimum);
-  calculateAngleLimits(Eikonal::Temperature::cMaximum);
-  calculateAngleLimits(Eikonal::Temperature::cAmbient);
-  mLimitPixelDeep       = calculatePixelLimitZ(*mLimitAngleDeep);
-  mLimitPixelShallow    = calculatePixelLimitZ(*mLimitAngleShallow);
-  if(*aNameSurf != 0) {
-    renderSurface(aNameSurf);
+  mProfiler.measure("angle limits base", [this]{ calculateAngleLimits(Eikonal::Temperature::cBase); });
+  mProfiler.measure("pixel limits", [this]{
+    mLimitPixelBaseTop        = calculatePixelLimitY(*mLimitAngleTop);
+    mLimitPixelBaseBottom     = calculatePixelLimitY(*mLimitAngleBottom);
+    mLimitPixelBaseBottomSurf = calculatePixelLimitY(mLimitAngleBottomSurf);
+  });
+  mProfiler.measure("angle limits minimum", [this]{ calculateAngleLimits(Eikonal::Temperature::cMinimum); });
+  mProfiler.measure("angle limits maximum", [this]{ calculateAngleLimits(Eikonal::Temperature::cMaximum); });
+  mProfiler.measure("angle limits ambient", [this]{ calculateAngleLimits(Eikonal::Temperature::cAmbient); });
+  mProfiler.measure("pixel limits", [this]{
+    mLimitPixelDeep       = calculatePixelLimitZ(*mLimitAngleDeep);
+    mLimitPixelShallow    = calculatePixelLimitZ(*mLimitAngleShallow);
+  });
+}
+
+void Image::prepareTiles(bool const aRenderSurface, char const * const aNameState) {
+  mProfiler.reset(mProfile, getThreadCount());
+  calculateLimits(aRenderSurface);
+  mProfiler.measure("write", [this, aNameState, aRenderSurface]{ writeState(aNameState, aRenderSurface); });
+}
+
+void Image::processTile(png::image<png::gray_pixel> const &aSurface, char const * const aNameState, uint32_t const aIndex, uint32_t const aCount, char const * const aNameTile) {
+  if(mOutputFormat == OutputFormat::cRaw || aIndex >= aCount) {
+    throw std::runtime_error("Tiles need an index below the count and an output format other than raw.");
+  }
+  else {} // nothing to do
+  bool const renderSurf = (aSurface.get_width() > 0u);
+  mDeadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(mTimeBudget));
+  mUnderRefined.clear();
+  mProfiler.reset(mProfile, getThreadCount());
+  bool prepared;
+  mProfiler.measure("read state", [this, aNameState, &prepared]{ prepared = readState(aNameState); });
+  if(prepared != renderSurf) {
+    throw std::runtime_error(std::string("Surface rendering differs from the one prepared in ") + aNameState);
+  }
+  else {} // nothing to do
+  int const height = std::max(0, mLimitPixelTop - mLimitPixelBottom);
+  mMirageBottom = mLimitPixelBottom + static_cast<int>(aIndex) * height / static_cast<int>(aCount);
+  mMirageTop    = mLimitPixelBottom + static_cast<int>(aIndex + 1u) * height / static_cast<int>(aCount);
+  mMirageDeep    = mLimitPixelDeep;
+  mMirageShallow = mLimitPixelShallow;
+  if(renderSurf && aIndex == 0u) {
+    mProfiler.measure("surface", [this, &aSurface]{ renderSurface(aSurface, getThreadCount()); });
+  }
+  else {} // nothing to do
+  mProfiler.measure("mirage", [this]{ calculateMirage(getThreadCount()); });
+  mProfiler.measure("write", [this, aNameTile]{ writeTile(aNameTile); });
+}
+
+void Image::mergeTiles(char const * const aNameState, std::vector<std::string> const& aNameTiles, char const * const aNameOut, char const * const aNameMarks) {
+  if(mOutputFormat == OutputFormat::cRaw) {
+    throw std::runtime_error("Tiles can't be merged into raw output.");
+  }
+  else {} // nothing to do
+  mUnderRefined.clear();
+  mProfiler.reset(mProfile, getThreadCount());
+  mProfiler.measure("read state", [this, aNameState]{ readState(aNameState); });
+  mProfiler.measure("read tiles", [this, &aNameTiles]{
+    for(auto const& name : aNameTiles) {
+      readTile(name.c_str());
+    }
+  });
+  mProfiler.measure("marks", [this]{ drawMarks(mMirrorHeight); });
+  mProfiler.measure("write", [this, aNameOut, aNameMarks]{ write(aNameOut, aNameMarks); });
+}
+
+void Image::processRoi(Roi const& aRoi, char const * const aNameOut, char const * const aNameInfo) {
+  if(mOutputFormat == OutputFormat::cRaw || mRetainHits || aRoi.mZoom == 0u) {
+    throw std::runtime_error("An ROI needs a positive zoom, an output format other than raw and no retained hits.");
+  }
+  else {} // nothing to do
+  mDeadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(mTimeBudget));
+  mUnderRefined.clear();
+  mProfiler.reset(mProfile, getThreadCount());
+  calculateLimits(false);
+
+  int const frameWidth = mImage.get_width();
+  int const frameHeight = mImage.get_height();
+  int left, top, right, bottom;
+  if(aRoi.mDegrees) {
+    // Pixel coordinates grow against the output image ones.
+    int z1 = calculatePixelLimitZ(aRoi.mX1 * cgPi / 180.0);
+    int z2 = calculatePixelLimitZ(aRoi.mX2 * cgPi / 180.0);
+    int y1 = calculatePixelLimitY(aRoi.mY1 * cgPi / 180.0);
+    int y2 = calculatePixelLimitY(aRoi.mY2 * cgPi / 180.0);
+    left   = frameWidth - 1 - std::max(z1, z2);
+    right  = frameWidth - std::min(z1, z2);
+    top    = frameHeight - 1 - std::max(y1, y2);
+    bottom = frameHeight - std::min(y1, y2);
+  }
+  else {
+    left   = static_cast<int>(std::floor(std::min(aRoi.mX1, aRoi.mX2)));
+    right  = static_cast<int>(std::ceil(std::max(aRoi.mX1, aRoi.mX2)));
+    top    = static_cast<int>(std::floor(std::min(aRoi.mY1, aRoi.mY2)));
+    bottom = static_cast<int>(std::ceil(std::max(aRoi.mY1, aRoi.mY2)));
+  }
+  left   = std::clamp(left, 0, frameWidth);
+  right  = std::clamp(right, 0, frameWidth);
+  top    = std::clamp(top, 0, frameHeight);
+  bottom = std::clamp(bottom, 0, frameHeight);
+  if(left >= right || top >= bottom) {
+    throw std::runtime_error("The ROI lies outside the frame.");
+  }
+  else {} // nothing to do
+  writeRoiInfo(aNameInfo, left, top, right, bottom, aRoi.mZoom);
+
+  // Zoomed pixel k * p + m has its centre at full frame pixel p + (m - (k - 1) / 2) / k.
+  int const zoom = aRoi.mZoom;
+  resizeBuffers(zoom * (right - left), zoom * (bottom - top));
+  mFrameWidth  = zoom * frameWidth;
+  mFrameHeight = zoom * frameHeight;
+  mWindowX     = zoom * left;
+  mWindowY     = zoom * top;
+  mZoom        = zoom;
+  mBiasZ       = zoom * mBiasZ + (zoom - 1.0) / 2.0;
+  mBiasY       = zoom * mBiasY + (zoom - 1.0) / 2.0;
+  mPixelSize  /= zoom;
+  // The mirage edges stay at pixel edges, the sensitive rows go to the pixel centres.
+  mLimitPixelTop        *= zoom;
+  mLimitPixelBottom     *= zoom;
+  mLimitPixelDeep       *= zoom;
+  mLimitPixelShallow    *= zoom;
+  mLimitPixelBaseTop     = zoom * mLimitPixelBaseTop + zoom / 2;
+  mLimitPixelBaseBottom  = zoom * mLimitPixelBaseBottom + zoom / 2;
+  mMirrorHeight          = zoom * mMirrorHeight + zoom / 2;
+  mMirageBottom  = std::max(mLimitPixelBottom, mFrameHeight - mWindowY - static_cast<int>(mImage.get_height()));
+  mMirageTop     = std::max(mMirageBottom, std::min(mLimitPixelTop, mFrameHeight - mWindowY));
+  mMirageDeep    = std::max(mLimitPixelDeep, mFrameWidth - mWindowX - static_cast<int>(mImage.get_width()));
+  mMirageShallow = std::max(mMirageDeep, std::min(mLimitPixelShallow, mFrameWidth - mWindowX));
+  mProfiler.measure("mirage", [this]{ calculateMirage(getThreadCount()); });
+  mProfiler.measure("write", [this, aNameOut]{ write(aNameOut, ""); });
+}
+
+void Image::reshade(Parameters const& aPara, char const * const aNameOut, char const * const aNameMarks) {
+  mMarkIndent = std::max(0.0, std::min(1.0, aPara.mMarkIndent));
+  mMarkAcross = aPara.mMarkAcross;
+  mMarkTriple = aPara.mMarkTriple;
+  shadeMirage();
+  std::fill(mMarks.begin(), mMarks.end(), csColorVoid);
+  drawMarks(mMirrorHeight);
+  write(aNameOut, aNameMarks);
+}
+
+void Image::processSplat(char const * const aNameOut) {
+  mUnderRefined.clear();
+  mProfiler.reset(mProfile, getThreadCount());
+  calculateLimits(false);
+  mMirageBottom  = mLimitPixelBottom;
+  mMirageTop     = mLimitPixelTop;
+  mMirageDeep    = mLimitPixelDeep;
+  mMirageShallow = mLimitPixelShallow;
+  mProfiler.measure("splat", [this]{ calculateSplat(); });
+  mProfiler.measure("write", [this, aNameOut]{ writeFloat32(aNameOut); });
+}
+
+void Image::prepareWarp() {
+  if(mMedium.getObjectCount() > 1u) {
+    throw std::runtime_error("Warping needs a scene of the billboard alone.");
+  }
+  else {} // nothing to do
+  uint32_t const rayWidth = mImage.get_width() * mSubSample;
+  uint32_t const rayCount = mSubSample * mSubSample;
+  mWarpPixels.clear();
+  mWarpTexels.clear();
+  for(int y = mLimitPixelBottom; y < mLimitPixelTop; ++y) {
+    for(int z = mLimitPixelDeep; z < mLimitPixelShallow; ++z) {
+      mWarpPixels.push_back((mImage.get_width() - z - 1u) + mImage.get_width() * (mImage.get_height() - y - 1u));
+      for(uint32_t k = 0; k < rayCount; ++k) {
+        auto const& hit = mRetained[((mImage.get_width() - z - 1u) * mSubSample + mSubSample - 1u - k / mSubSample) +
+                                    ((mImage.get_height() - y - 1u) * mSubSample + mSubSample - 1u - k % mSubSample) * rayWidth];
+        mWarpTexels.push_back(std::isnan(hit(0)) ? mMedium.getTexelCount() : mMedium.getTexelIndex(hit));
+      }
+    }
+  }
+  mWarpFrame.assign(mMedium.getTexelCount() + 1u, 0u);
+}
+
+// The pixels are independent, so the threads of the pool take them in chunks.
+void Image::shadeWarp(uint8_t const * const aFrame) {
+  std::copy(aFrame, aFrame + mWarpFrame.size() - 1u, mWarpFrame.begin());
+  uint32_t const rayCount = mSubSample * mSubSample;
+  mPool.run(mWarpPixels.size(), csWarpChunk, [this, rayCount](uint32_t const, uint64_t const aBegin, uint64_t const aEnd) {
+    uint8_t const * const frame = mWarpFrame.data();
+    for(uint64_t p = aBegin; p < aEnd; ++p) {
+      uint32_t const * const texels = &mWarpTexels[p * rayCount];
+      uint32_t sum = 0u;
+      for(uint32_t k = 0u; k < rayCount; ++k) {
+        sum += frame[texels[k]];
+      }
+      mBuffer[mWarpPixels[p]] = sum / static_cast<double>(rayCount);
+    }
+  });
+}
+
+void Image::warp(uint8_t const * const aFrame, char const * const aNameOut, bool const aBurnMarks) {
+  shadeWarp(aFrame);
+  writeImage(aNameOut, aBurnMarks);
+}
+
+void Image::warp(uint8_t const * const aFrame, std::ostream &aOut, bool const aHeader, uint32_t const aFps) {
+  shadeWarp(aFrame);
+  uint32_t const width = mImage.get_width();
+  uint32_t const height = mImage.get_height();
+  if(aHeader) {
+    aOut << "YUV4MPEG2 W" << width << " H" << height << " F" << aFps << ":1 Ip A1:1 C444 XCOLORRANGE=FULL\n";
+  }
+  else {} // nothing to do
+  std::array<std::array<uint8_t, 3u>, 256u> yuv;
+  for(uint32_t i = 0u; i < yuv.size(); ++i) {
+    auto const& color = mPalette[i];
+    double r = color.red;
+    double g = color.green;
+    double b = color.blue;
+    yuv[i][0] = static_cast<uint8_t>(std::clamp(::round(0.299 * r + 0.587 * g + 0.114 * b), 0.0, 255.0));
+    yuv[i][1] = static_cast<uint8_t>(std::clamp(::round(128.0 - 0.168736 * r - 0.331264 * g + 0.5 * b), 0.0, 255.0));
+    yuv[i][2] = static_cast<uint8_t>(std::clamp(::round(128.0 + 0.5 * r - 0.418688 * g - 0.081312 * b), 0.0, 255.0));
+  }
+  std::vector<uint8_t> frame(3u * width * height);
+  for(uint32_t i = 0u; i < width * height; ++i) {
+    auto const& color = yuv[getIndexed(i, true)];
+    frame[i]                      = color[0];
+    frame[i + width * height]     = color[1];
+    frame[i + 2u * width * height] = color[2];
+  }
+  aOut << "FRAME\n";
+  aOut.write(reinterpret_cast<char const*>(frame.data()), frame.size());
+}
+
+void Image::write(char const * const aNameOut, char const * const aNameMarks) {
+  bool separateMarks = (*aNameMarks != 0);
+  writeImage(aNameOut, !separateMarks);
+  if(separateMarks) {
+    writeMarks(aNameMarks);
   }
   else {} // nothing to do
-  int mirrorHeight = calculateMirrorHeight();
-  calculateMirage();
-  drawMarks(mirrorHeight);
-  mImage.write(aNameOut);
+}
+
+void Image::writeImage(char const * const aNameOut, bool const aBurnMarks) {
+  if(mOutputFormat == OutputFormat::cIndexed8) {
+    writeIndexed8(aNameOut, aBurnMarks);
+  }
+  else if(mOutputFormat == OutputFormat::cGray16) {
+    writeGray16(aNameOut);
+  }
+  else if(mOutputFormat == OutputFormat::cFloat32) {
+    writeFloat32(aNameOut);
+  }
+  else {
+    writeRaw(aNameOut);
+  }
 }
 
 void Image::calculateAngleLimits(Eikonal::Temperature const aWhich) {
   mMedium.setWaterTempAmb(aWhich);
+  auto& scan = mAngleScans[static_cast<uint32_t>(aWhich)];
+  if(!scan.mCriticals) {
+    scan.mCriticals = scanCriticals(mMedium, mHints.mCriticals[static_cast<uint32_t>(aWhich)]);
+    mHints.mCriticals[static_cast<uint32_t>(aWhich)] = *scan.mCriticals;
+  }
+  else {} // nothing to do
+  bool was = false;
+  double limitAnglePrev;
+  for(auto critical : *scan.mCriticals) {
+    limitAnglePrev = mLimitAngleTop.value_or(0.0);
+    auto tmp = critical * csLimitAngleBoost;
+    mLimitAngleTop = (mLimitAngleTop ? std::max(*mLimitAngleTop, tmp) : tmp);
+    if(!was) {
+      mLimitAngleBottom = (mLimitAngleBottom ? std::min(*mLimitAngleBottom, tmp) : tmp);
+      was = true;
+    }
+    else {} // nothing to do
+  }
+  auto angleY = (limitAnglePrev + *mLimitAngleTop) / 2.0;
+  if(!scan.mDeep || scan.mDeepAngleY != angleY) {
+    Ray ray;
+    ray.mStart = mPinhole;
+    ray.mDirection = getDirectionYz(angleY, csLimitLow - csLimitDelta);
+    scan.mDeep = binarySearch(csLimitLow, 0.0, csLimitEpsilon, [this, &ray, angleY](auto const search){
+      ray.mDirection = getDirectionYz(angleY, search);
+      return mMedium.hits(ray);
+    });
+    scan.mDeepAngleY = angleY;
+  }
+  else {} // nothing to do
+  auto tmp = *scan.mDeep * csLimitAngleBoost;
+  mLimitAngleDeep = (mLimitAngleDeep ? std::min(*mLimitAngleDeep, tmp) : tmp);
+  mLimitAngleShallow = -*mLimitAngleDeep;
+}
+
+// The angles are accumulated exactly like the original full scan did, so a bracketed scan finds the same values.
+std::vector<double> const& Image::getLimitGrid() {
+  static std::vector<double> const cGrid = [](){
+    std::vector<double> result;
+    for(auto angle = csLimitLow; angle <= csLimitHigh; angle += csLimitDelta) {
+      result.push_back(angle);
+    }
+    return result;
+  }();
+  return cGrid;
+}
+
+// Only scans windows around the critical angles of the previous frame. The hit state must agree at the borders
+// of the windows and at every csLimitGapStride-th grid angle between them, otherwise a critical angle might have
+// moved out of them or a new pair appeared between them, and the full range is scanned.
+std::vector<double> Image::scanCriticals(Medium &aMedium, std::vector<double> const& aHints) {
+  auto const& grid = getLimitGrid();
+  int const last = grid.size() - 1;
+  std::vector<std::pair<int, int>> windows;
+  for(auto hint : aHints) {
+    int centre = std::lower_bound(grid.begin(), grid.end(), hint) - grid.begin();
+    int begin = std::max(0, centre - csLimitWarmWindow);
+    int end = std::min(last, centre + csLimitWarmWindow);
+    if(!windows.empty() && begin <= windows.back().second) {
+      windows.back().second = end;
+    }
+    else {
+      windows.emplace_back(begin, end);
+    }
+  }
   Ray ray;
   ray.mStart = mPinhole;
   ray.mDirection = getDirectionInXy(csLimitLow - csLimitDelta);
-  auto lastHit = mMedium.hits(ray);
-  bool was = false;
-  double limitAnglePrev;
-  for(auto angle = csLimitLow; angle <= csLimitHigh; angle += csLimitDelta) {
+  bool const hitBefore = aMedium.hits(ray);
+  std::vector<double> result;
+  // Checks the grid angles after aFrom up to aTo inclusive, which must be checked itself.
+  auto gapHolds = [&aMedium, &ray, &grid](int const aFrom, int const aTo, bool const aExpected) {
+    bool result = true;
+    for(int i = aFrom + csLimitGapStride; result && i < aTo; i += csLimitGapStride) {
+      ray.mDirection = getDirectionInXy(grid[i]);
+      result = (aMedium.hits(ray) == aExpected);
+    }
+    if(result) {
+      ray.mDirection = getDirectionInXy(grid[aTo]);
+      result = (aMedium.hits(ray) == aExpected);
+    }
+    else {} // nothing to do
+    return result;
+  };
+  bool valid = !windows.empty();
+  bool expected = hitBefore;
+  int checked = -1;
+  for(auto const& window : windows) {
+    if(!gapHolds(checked, window.first, expected)) {
+      valid = false;
+      break;
+    }
+    else {} // nothing to do
+    expected = scanCriticals(aMedium, window.first + 1, window.second, expected, result);
+    checked = window.second;
+  }
+  if(valid && checked < last) {
+    valid = gapHolds(checked, last, expected);
+  }
+  else {} // nothing to do
+  if(!valid) {
+    result.clear();
+    scanCriticals(aMedium, 0, last, hitBefore, result);
+  }
+  else {} // nothing to do
+  return result;
+}
+
+// Scans grid indices aBegin..aEnd inclusive, returns the hit state at aEnd.
+bool Image::scanCriticals(Medium &aMedium, int const aBegin, int const aEnd, bool const aLastHit, std::vector<double> &aCriticals) {
+  auto const& grid = getLimitGrid();
+  Ray ray;
+  ray.mStart = mPinhole;
+  auto lastHit = aLastHit;
+  for(int i = aBegin; i <= aEnd; ++i) {
+    auto angle = grid[i];
     ray.mDirection = getDirectionInXy(angle);
-    auto thisHit = mMedium.hits(ray);
+    auto thisHit = aMedium.hits(ray);
     if(lastHit != thisHit) {
-      auto critical = binarySearch(angle - csLimitDelta, angle, csLimitEpsilon, [this, &ray](auto const search){
+      auto critical = binarySearch(angle - csLimitDelta, angle, csLimitEpsilon, [&aMedium, &ray](auto const search){
         ray.mDirection = getDirectionInXy(search);
-        return mMedium.hits(ray);
+        return aMedium.hits(ray);
       });
       critical += (thisHit ? csLimitEpsilon : 0.0);
-      limitAnglePrev = mLimitAngleTop.value_or(0.0);
-      auto tmp = critical * csLimitAngleBoost;
-      mLimitAngleTop = (mLimitAngleTop ? std::max(*mLimitAngleTop, tmp) : tmp);
-      if(!was) {
-        mLimitAngleBottom = (mLimitAngleBottom ? std::min(*mLimitAngleBottom, tmp) : tmp);
-        was = true;
-      }
-      else {} // nothing to do
+      aCriticals.push_back(critical);
     }
     else {} // nothing to do
     lastHit = thisHit;
   }
-  auto angleY = (limitAnglePrev + *mLimitAngleTop) / 2.0;
-  ray.mDirection = getDirectionYz(angleY, csLimitLow - csLimitDelta);
-  auto tmp = binarySearch(csLimitLow, 0.0, csLimitEpsilon, [this, &ray, angleY](auto const search){
-    ray.mDirection = getDirectionYz(angleY, search);
-    return mMedium.hits(ray);
-  });
-  tmp *= csLimitAngleBoost;
-  mLimitAngleDeep = (mLimitAngleDeep ? std::min(*mLimitAngleDeep, tmp) : tmp);
-  mLimitAngleShallow = -*mLimitAngleDeep;
+  return lastHit;
 }
 
 void Image::calculateBiases(bool const aRenderSurface) {
@@ -187,10 +825,34 @@ void Image::calculateBiases(bool const aRenderSurface) {
   mBiasZ = (mResolutionX - 1.0) * (mCenter - limitDeep).norm() / width;
   mBiasY = (resolutionY - 1.0) * (mCenter - limitBottom).norm() / height;
   mPixelSize = (width / mResolutionX + height / resolutionY) / 2.0;
+  resizeBuffers(mResolutionX, resolutionY);
+}
 
-  mBuffer.reserve(mResolutionX * resolutionY);
-  mBuffer.insert(mBuffer.begin(), mResolutionX * resolutionY, csColorVoid);
-  mImage.resize(mResolutionX, resolutionY);
+void Image::resizeBuffers(uint32_t const aWidth, uint32_t const aHeight) {
+  mFrameWidth  = aWidth;
+  mFrameHeight = aHeight;
+  mWindowX     = 0;
+  mWindowY     = 0;
+  mZoom        = 1u;
+  mBuffer.assign(aWidth * aHeight, std::nanf(""));
+  mMarks.assign(aWidth * aHeight, csColorVoid);
+  if(mOutputFormat == OutputFormat::cRaw) {
+    auto rayCount = aWidth * aHeight * mSubSample * mSubSample;
+    mHits.mY.assign(rayCount, std::nanf(""));
+    mHits.mZ.assign(rayCount, std::nanf(""));
+    mHits.mStepCount.assign(rayCount, 0u);
+    mHits.mValid.assign(rayCount, 0u);
+  }
+  else {} // nothing to do
+  if(mRetainHits) {
+    auto nan = std::nan("");
+    mRetained.assign(aWidth * aHeight * mSubSample * mSubSample, Vertex(nan, nan, nan));
+  }
+  else {} // nothing to do
+#ifdef SOLVER_STATISTICS
+  mPixelStatistics.assign(aWidth * aHeight, SolverStatistics());
+#endif
+  mImage.resize(aWidth, aHeight);
 }
 
 int Image::calculatePixelLimitZ(double const aAngle) {
@@ -237,78 +899,431 @@ int Image::calculatePixelLimitY(double const aAngle) {
   return result;
 }
 
-int Image::calculateMirrorHeight() {
+int Image::calculateMirrorHeight(uint32_t const aThreadCount) {
+  int height = mImage.get_height();
   int result = -1;
-  double minHit = std::numeric_limits<double>::max();
-  int z = mImage.get_width() / 2;
-  Ray ray;
-  ray.mStart = mPinhole;
-  for(int y = 0; y < mImage.get_height(); ++y) {
-    Vertex subpixel = mCenter + mPixelSize * (
-      (z - mBiasZ) * mInPlaneZ +
-      (y - mBiasY) * mInPlaneY);
-    ray.mDirection = (mPinhole - subpixel).normalized();
-    auto hit = mMedium.getHit(ray);
-    if(hit.mValid && hit.mValue(1) < minHit) {
-      minHit = hit.mValue(1);
-      result = y;
+  if(mHints.mMirrorAngle) {
+    auto centre = calculatePixelLimitY(*mHints.mMirrorAngle);
+    auto begin = std::max(0, centre - csMirrorWarmWindow);
+    auto end = std::min(height, centre + csMirrorWarmWindow + 1);
+    result = calculateMirrorHeight(begin, end, aThreadCount);
+    if(result <= begin || result >= end - 1) {  // The real minimum may lie outside.
+      result = -1;
     }
     else {} // nothing to do
   }
+  else {} // nothing to do
+  if(result < 0) {
+    result = calculateMirrorHeight(0, height, aThreadCount);
+  }
+  else {} // nothing to do
+  if(result >= 0) {
+    Vertex subpixel = mCenter + mPixelSize * (
+      (static_cast<int>(mImage.get_width() / 2) - mBiasZ) * mInPlaneZ +
+      (result - mBiasY) * mInPlaneY);
+    Vector direction = (mPinhole - subpixel).normalized();
+    mHints.mMirrorAngle = std::atan(direction(1) / direction(0));
+  }
+  else {
+    mHints.mMirrorAngle.reset();
+  }
   return result;
 }
 
-void Image::renderSurface(char const * const aNameSurf) {
-  png::image<png::gray_pixel> surface(aNameSurf);
+// The rows are split among threads, each with its own medium. On equal heights the lowest row wins, like in one pass.
+int Image::calculateMirrorHeight(int const aBegin, int const aEnd, uint32_t const aThreadCount) {
+  uint32_t const nThreads = std::max(1, std::min(static_cast<int>(aThreadCount), aEnd - aBegin));
+  std::vector<std::pair<double, int>> best(nThreads, { std::numeric_limits<double>::max(), -1 });
+  std::vector<std::thread> threads(nThreads);
+  for(uint32_t i = 0u; i < nThreads; ++i) {
+    threads[i] = std::thread([this, &best, aBegin, aEnd, nThreads, i] {
+      Medium localMedium(mMedium);
+      int z = mImage.get_width() / 2;
+      Ray ray;
+      ray.mStart = mPinhole;
+      for(int y = aBegin + i * (aEnd - aBegin) / nThreads; y < aBegin + (i + 1) * (aEnd - aBegin) / nThreads; ++y) {
+        Vertex subpixel = mCenter + mPixelSize * (
+          (z - mBiasZ) * mInPlaneZ +
+          (y - mBiasY) * mInPlaneY);
+        ray.mDirection = (mPinhole - subpixel).normalized();
+        auto hit = localMedium.getHit(ray);
+        if(hit.mValid && hit.mValue(1) < best[i].first) {
+          best[i] = { hit.mValue(1), y };
+        }
+        else {} // nothing to do
+      }
+    });
+  }
+  for(auto& t : threads) {
+    t.join();
+  }
+  std::pair<double, int> result = { std::numeric_limits<double>::max(), -1 };
+  for(auto const& candidate : best) {
+    if(candidate.second >= 0 && candidate.first < result.first) {
+      result = candidate;
+    }
+    else {} // nothing to do
+  }
+  return result.second;
+}
+
+// Each pixel is the average of csSurfSubsample x csSurfSubsample texels. The column of a subsample depends only
+// on the pixel column, and its row only on the pixel row, so the sum is done in two passes: first the texels
+// of each distinct row are summed per pixel column, then these sums are weighted by how many subsample rows
+// fall on that texel row. The sums are integers, so the result is the same as adding them one by one.
+void Image::renderSurface(png::image<png::gray_pixel> const &aSurface, uint32_t const aThreadCount) {
   auto ssFactor = 1.0 / csSurfSubsample;
-  auto transform = static_cast<double>(surface.get_width()) / (mLimitPixelShallow - mLimitPixelDeep);
-  for(int y = mLimitPixelBaseBottomSurf; y <= mLimitPixelBottom; ++y) {
-    for(int x = mLimitPixelDeep; x < mLimitPixelShallow - 1; ++x) {
-      double sum = 0.0;
-      for(int i = 0; i < csSurfSubsample; ++i) {
-        for(int j = 0; j < csSurfSubsample; ++j) {
-          auto effectiveX = static_cast<int>((x + i * ssFactor - mLimitPixelDeep) * transform);
+  auto transform = static_cast<double>(aSurface.get_width()) / (mLimitPixelShallow - mLimitPixelDeep);
+  int const width = std::max(0, mLimitPixelShallow - 1 - mLimitPixelDeep);
+  std::vector<uint32_t> columns(static_cast<size_t>(width) * csSurfSubsample);
+  for(int x = mLimitPixelDeep; x < mLimitPixelShallow - 1; ++x) {
+    for(int i = 0; i < csSurfSubsample; ++i) {
+      auto effectiveX = static_cast<int>((x + i * ssFactor - mLimitPixelDeep) * transform);
+      columns[(x - mLimitPixelDeep) * csSurfSubsample + i] = aSurface.get_width() - 1 - effectiveX;
+    }
+  }
+  // The mirage overwrites the last row, if it has any rows, so that is left to it.
+  int const yEnd = (mLimitPixelTop > mLimitPixelBottom ? mLimitPixelBottom : mLimitPixelBottom + 1);
+  int const height = std::max(0, yEnd - mLimitPixelBaseBottomSurf);
+  uint32_t const nThreads = std::max(1, std::min(static_cast<int>(aThreadCount), height));
+  std::vector<std::thread> threads(nThreads);
+  for(uint32_t t = 0u; t < nThreads; ++t) {
+    threads[t] = std::thread([this, &aSurface, &columns, ssFactor, transform, width, height, nThreads, t] {
+      std::vector<uint8_t>  texels(aSurface.get_width());
+      std::vector<uint32_t> sums(width);
+      for(int y = mLimitPixelBaseBottomSurf + t * height / nThreads; y < mLimitPixelBaseBottomSurf + (t + 1) * height / nThreads; ++y) {
+        std::fill(sums.begin(), sums.end(), 0u);
+        int j = 0;
+        while(j < csSurfSubsample) {
           auto effectiveY = static_cast<int>((y + j * ssFactor - mLimitPixelBaseBottomSurf) * transform);
-          if(effectiveY < surface.get_height()) {
-            sum += surface.get_pixel(surface.get_width() - 1 - effectiveX, surface.get_height() - 1 - effectiveY);
+          uint32_t weight = 1u;
+          for(++j; j < csSurfSubsample && static_cast<int>((y + j * ssFactor - mLimitPixelBaseBottomSurf) * transform) == effectiveY; ++j) {
+            ++weight;
+          }
+          if(effectiveY < aSurface.get_height()) {
+            uint32_t const row = aSurface.get_height() - 1 - effectiveY;
+            for(uint32_t x = 0u; x < texels.size(); ++x) {
+              texels[x] = aSurface.get_pixel(x, row);
+            }
+            for(int x = 0; x < width; ++x) {
+              uint32_t sum = 0u;
+              for(int i = 0; i < csSurfSubsample; ++i) {
+                sum += texels[columns[x * csSurfSubsample + i]];
+              }
+              sums[x] += weight * sum;
+            }
+          }
+          else {} // nothing to do
+        }
+        auto *target = &mBuffer[mImage.get_width() * (mImage.get_height() - y - 1)];
+        for(int x = 0; x < width; ++x) {
+          target[mImage.get_width() - (x + mLimitPixelDeep) - 2] = sums[x] / static_cast<double>(csSurfSubsample * csSurfSubsample);
+        }
+      }
+    });
+  }
+  for(auto& thread : threads) {
+    thread.join();
+  }
+}
+
+uint32_t Image::getThreadCount() const {
+  uint32_t result = mThreadCount;
+  if(result == 0u) {
+    result = std::thread::hardware_concurrency();
+    result -= (result <= mRestrictCpu ? result - 1u : mRestrictCpu);
+  }
+  else {} // nothing to do
+  return result;
+}
+
+void Image::calculateMirage(uint32_t const aThreadCount) {
+  auto begin = std::chrono::steady_clock::now();
+  uint32_t nCpus = aThreadCount;
+  mMirrorColumns = (mTimeBudget <= 0.0 && isSymmetric());
+  mMirageRayCount = static_cast<uint64_t>(std::max(0, mMirageTop - mMirageBottom)) * getTracedColumnCount();
+  if(mTimeBudget > 0.0) {
+    calculateMirageBudgeted(nCpus);
+  }
+  else if(!mNameJournal.empty()) {
+    calculateMirageJournaled(nCpus);
+  }
+  else if(isBatchable()) {
+    calculateMirageBatched(nCpus);
+    mMirageRayCount *= mSubSample * mSubSample;
+  }
+  else {
+    std::vector<std::thread> threads(nCpus);
+    for (uint32_t i = 0u; i < nCpus; ++i) {
+      threads[i] = std::thread([this, nCpus, i] {
+        Profiler::ThreadScope profile(mProfiler, i);
+        Medium localMedium(mMedium);
+        std::optional<Medium> looseMedium;
+        if(mTolLoose != 1.0 || mPrecision != RungeKuttaRayBending::Precision::cDouble) {
+          looseMedium.emplace(mMedium, mTolLoose, mPrecision);
+        }
+        else {} // nothing to do
+        std::vector<Vertex> rowHits;
+        auto yBegin = mMirageBottom + i * (mMirageTop - mMirageBottom) / nCpus;
+        auto yEnd = mMirageBottom + (i + 1u) * (mMirageTop - mMirageBottom) / nCpus;
+        for(int y = yBegin; y < yEnd; ++y) {
+          traceRow(localMedium, y, looseMedium ? &*looseMedium : nullptr, rowHits);
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    mMirageRayCount *= mSubSample * mSubSample;
+  }
+  mMirageSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// The rows go to a BatchTracer in blocks, each row as a chunk, so its rays get the step hints in the same order
+// as in traceRow and the output is the same. The hits of a block are shaded here before the next one.
+void Image::calculateMirageBatched(uint32_t const aThreadCount) {
+  int const width = std::max(0, mMirageShallow - mMirageDeep);
+  int const blockRows = aThreadCount * csBatchRows;
+  double const x = mMedium.getBillboardX();
+  BatchTracer tracer(mMedium.getParameters(), mMedium.getEikonal(), aThreadCount);
+  BatchTracer::Options options;
+  options.mChunk = std::max(1u, width * mSubSample * mSubSample);
+  options.mStepHints = mStepHints;
+  std::vector<BatchTracer::Request> requests;
+  std::vector<BatchTracer::Outcome> outcomes;
+  for(int yBlock = mMirageBottom; yBlock < mMirageTop; yBlock += blockRows) {
+    int const yEnd = std::min(mMirageTop, yBlock + blockRows);
+    requests.clear();
+    for(int y = yBlock; y < yEnd; ++y) {
+      for(int z = mMirageDeep; z < mMirageShallow; ++z) {
+        for(uint32_t i = 0; i < mSubSample; ++i) {
+          for(uint32_t j = 0; j < mSubSample; ++j) {
+            BatchTracer::Request request;
+            request.mRay.mStart = mPinhole;
+            request.mRay.mDirection = getRayDirection(y, z, i, j);
+            request.mX = x;
+            requests.push_back(request);
+          }
+        }
+      }
+    }
+    tracer.traceBatch(requests, outcomes, options);
+    auto outcome = outcomes.cbegin();
+    for(int y = yBlock; y < yEnd; ++y) {
+      for(int z = mMirageDeep; z < mMirageShallow; ++z) {
+        double sum = 0.0;
+        for(uint32_t i = 0; i < mSubSample; ++i) {
+          for(uint32_t j = 0; j < mSubSample; ++j) {
+            sum += (outcome->mStatus == BatchTracer::Status::cValid ? mMedium.getPixel(outcome->mResult.mValue) : 0u);
+            storeHit(y, z, i, j, outcome->mResult);
+            ++outcome;
+          }
+        }
+        mBuffer[getPixelIndex(y, z)] = sum / static_cast<double>(mSubSample * mSubSample);
+      }
+    }
+  }
+}
+
+// First traces one ray per pixel with a step budget adapted to the mean step count, so a complete coarse image
+// is always ready. Then the pixels get fully subsampled until the deadline, starting with those whose ray
+// exceeded the budget, followed by the ones differing most from their neighbours.
+void Image::calculateMirageBudgeted(uint32_t const aThreadCount) {
+  int const width = std::max(0, mMirageShallow - mMirageDeep);
+  int const height = std::max(0, mMirageTop - mMirageBottom);
+  std::vector<uint8_t> capped(width * height, 0u);
+  std::vector<std::thread> threads(aThreadCount);
+  for (uint32_t i = 0u; i < aThreadCount; ++i) {
+    threads[i] = std::thread([this, &capped, aThreadCount, i, width, height] {
+      Profiler::ThreadScope profile(mProfiler, i);
+      Medium localMedium(mMedium);
+      uint64_t stepSum = 0u;
+      uint32_t rayCount = 0u;
+      for(int y = i * height / aThreadCount; y < (i + 1u) * height / aThreadCount; ++y) {
+        RungeKuttaRayBending::StepSchedule schedule;
+        for(int z = 0; z < width; ++z) {
+          uint32_t maxStep = RungeKuttaRayBending::csMaxStep;
+          if(rayCount >= csStepBudgetWarmup) {
+            maxStep = std::clamp<uint64_t>(csStepBudgetFactor * stepSum / rayCount, csStepBudgetMin, RungeKuttaRayBending::csMaxStep);
           }
           else {} // nothing to do
+          uint32_t stepCount;
+          if(traceCoarse(localMedium, mMirageBottom + y, mMirageDeep + z, maxStep, stepCount, schedule)) {
+            capped[z + y * width] = 1u;
+          }
+          else {
+            stepSum += stepCount;
+            ++rayCount;
+          }
         }
       }
-      uint8_t color = std::max(csColorBlack, static_cast<uint8_t>(::round(sum / static_cast<double>(csSurfSubsample * csSurfSubsample))));
-      mImage.set_pixel(mImage.get_width() - x - 2, mImage.get_height() - y - 1, color);
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  auto getValue = [this](int const aY, int const aZ) {
+    auto value = mBuffer[getPixelIndex(aY, aZ)];
+    return std::isnan(value) ? 0.0 : value;
+  };
+  std::vector<double> priority(width * height);
+  for(int y = 0; y < height; ++y) {
+    for(int z = 0; z < width; ++z) {
+      double contrast = 0.0;
+      auto here = getValue(mMirageBottom + y, mMirageDeep + z);
+      if(y > 0) {
+        contrast = std::max(contrast, std::abs(here - getValue(mMirageBottom + y - 1, mMirageDeep + z)));
+      }
+      else {} // nothing to do
+      if(y < height - 1) {
+        contrast = std::max(contrast, std::abs(here - getValue(mMirageBottom + y + 1, mMirageDeep + z)));
+      }
+      else {} // nothing to do
+      if(z > 0) {
+        contrast = std::max(contrast, std::abs(here - getValue(mMirageBottom + y, mMirageDeep + z - 1)));
+      }
+      else {} // nothing to do
+      if(z < width - 1) {
+        contrast = std::max(contrast, std::abs(here - getValue(mMirageBottom + y, mMirageDeep + z + 1)));
+      }
+      else {} // nothing to do
+      priority[z + y * width] = (capped[z + y * width] != 0u ? std::numeric_limits<double>::infinity() : contrast);
     }
   }
+  std::vector<uint32_t> order(width * height);
+  std::iota(order.begin(), order.end(), 0u);
+  std::stable_sort(order.begin(), order.end(), [&priority](auto const aLeft, auto const aRight){
+    return priority[aLeft] > priority[aRight];
+  });
+
+  std::atomic<uint32_t> next = 0u;
+  for (uint32_t i = 0u; i < aThreadCount; ++i) {
+    threads[i] = std::thread([this, &order, &next, width, i] {
+      Profiler::ThreadScope profile(mProfiler, i);
+      Medium localMedium(mMedium);
+      while(std::chrono::steady_clock::now() < mDeadline) {
+        uint32_t pixel = next++;
+        if(pixel >= order.size()) {
+          break;
+        }
+        else {} // nothing to do
+        RungeKuttaRayBending::StepSchedule schedule;   // Pixels are not in order, only the subsamples are neighbours.
+        tracePixel(localMedium, mMirageBottom + order[pixel] / width, mMirageDeep + order[pixel] % width, schedule);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  auto refinedCount = std::min<uint32_t>(next, order.size());
+  mMirageRayCount += static_cast<uint64_t>(refinedCount) * mSubSample * mSubSample;
+  collectUnderRefined(order, refinedCount, width);
 }
 
-void Image::calculateMirage() {
-  uint32_t nCpus = std::thread::hardware_concurrency();
-  nCpus -= (nCpus <= mRestrictCpu ? nCpus - 1u : mRestrictCpu);
-  std::vector<std::thread> threads(nCpus);
-  for (uint32_t i = 0u; i < nCpus; ++i) {
-    threads[i] = std::thread([this, nCpus, i] {
-      Ray ray;
-      ray.mStart = mPinhole;
+// Rows around the critical angle, the base limits and the mirror line are sensitive to the solver tolerances and precision.
+bool Image::isTightRow(int const aY) const {
+  int const band = csTightBand * static_cast<int>(mZoom);
+  return std::abs(aY - mLimitPixelBottom) <= band || std::abs(aY - mLimitPixelBaseTop) <= band ||
+         std::abs(aY - mLimitPixelBaseBottom) <= band || std::abs(aY - mMirrorHeight) <= band;
+}
+
+// The medium, the surface and the objects not shifted sideways are symmetric to the plane z = 0, and so is the camera. So is the
+// frame if the pinhole projects to its center column, which holds if the angle limits are symmetric. Then the
+// ray through column z and subsample i is the mirror image of the one through column mFrameWidth - 1 - z and
+// subsample mSubSample - 1 - i, and hits the mirror image point. The time budget refines in its own order and
+// traces everything.
+bool Image::isSymmetric() const {
+  return mSymmetry && mMedium.isSymmetric() && std::abs(2.0 * mBiasZ - (mFrameWidth - 1)) < csSymmetryTolerance;
+}
+
+bool Image::isBatchable() const {
+#ifdef SOLVER_STATISTICS
+  return false;  // They are collected per pixel.
+#else
+  return mMedium.getObjectCount() == 1u && mTolLoose == 1.0 && mPrecision == RungeKuttaRayBending::Precision::cDouble && !mMirrorColumns;
+#endif
+}
+
+int Image::getTracedColumnCount() const {
+  int result = 0;
+  for(int z = mMirageDeep; z < mMirageShallow; ++z) {
+    int const partner = mFrameWidth - 1 - z;
+    result += (mMirrorColumns && partner >= mMirageDeep && partner < z ? 0 : 1);
+  }
+  return result;
+}
+
+// The rays through the corners of the subsample grid cut the film into cells, and each cell receives the rays
+// the billboard emits from the patch between the hits of its corners. So with rays emitted evenly the energy of
+// a cell is the texel value integrated over the patch, here over its two triangles with the mean of their corner
+// texels. It is divided by the patch of the same cell for straight rays to the distance of the hit. Where the rays bunch up near the mirror
+// line the patches grow, showing the brightening of the caustic, and where they fan out the image darkens. Cells
+// with a missed corner get nothing. Each thread traces a band of pixel rows, so their sums are disjoint.
+void Image::calculateSplat() {
+  auto begin = std::chrono::steady_clock::now();
+  uint32_t const nThreads = std::max(1, std::min(static_cast<int>(getThreadCount()), mMirageTop - mMirageBottom));
+  int const width = std::max(0, mMirageShallow - mMirageDeep);
+  uint32_t const gridWidth = width * mSubSample + 1u;
+  double const straightArea = mPixelSize * mSsFactor * mPixelSize * mSsFactor;
+  std::vector<std::thread> threads(nThreads);
+  for(uint32_t i = 0u; i < nThreads; ++i) {
+    threads[i] = std::thread([this, nThreads, width, gridWidth, straightArea, i] {
+      Profiler::ThreadScope profile(mProfiler, i);
       Medium localMedium(mMedium);
-      auto yBegin = mLimitPixelBottom + i * (mLimitPixelTop - mLimitPixelBottom) / nCpus;
-      auto yEnd = mLimitPixelBottom + (i + 1u) * (mLimitPixelTop - mLimitPixelBottom) / nCpus;
+      std::vector<Vertex> previous(gridWidth);
+      std::vector<Vertex> current(gridWidth);
+      std::vector<double> sums(width);
+      auto traceGridRow = [this, &localMedium, gridWidth](int const aY, uint32_t const aJ, std::vector<Vertex> &aHits) {
+        RungeKuttaRayBending::StepSchedule schedule;
+        Ray ray;
+        ray.mStart = mPinhole;
+        RungeKuttaRayBending::Result hit;
+        for(uint32_t h = 0u; h < gridWidth; ++h) {
+          Vertex corner = mCenter + mPixelSize * (
+                (mMirageDeep - mBiasZ - 0.5 + mSsFactor * h) * mInPlaneZ +
+                (aY - mBiasY - 0.5 + mSsFactor * aJ) * mInPlaneY);
+          ray.mDirection = (mPinhole - corner).normalized();
+          localMedium.trace(ray, hit, RungeKuttaRayBending::csMaxStep, mStepHints && schedule.mCount > 0u ? &schedule : nullptr);
+          if(hit.mValid) {
+            schedule = hit.mSchedule;
+          }
+          else {} // nothing to do
+          aHits[h] = (hit.mValid ? hit.mValue : Vertex::Constant(std::nan("")));
+        }
+      };
+      auto yBegin = mMirageBottom + i * (mMirageTop - mMirageBottom) / nThreads;
+      auto yEnd = mMirageBottom + (i + 1u) * (mMirageTop - mMirageBottom) / nThreads;
+      if(yBegin < yEnd) {
+        traceGridRow(yBegin, 0u, previous);
+      }
+      else {} // nothing to do
       for(int y = yBegin; y < yEnd; ++y) {
-        for(int z = mLimitPixelDeep; z < mLimitPixelShallow; ++z) {
-          double sum = 0.0;
-          for(uint32_t i = 0; i < mSubSample; ++i) {
-            for(uint32_t j = 0; j < mSubSample; ++j) {
-              Vertex subpixel = mCenter + mPixelSize * (
-                    (z - mBiasZ + mSsFactor * (i - mBiasSub)) * mInPlaneZ +
-                    (y - mBiasY + mSsFactor * (j - mBiasSub)) * mInPlaneY);
-              ray.mDirection = (mPinhole - subpixel).normalized();
-              auto angleY = std::atan(ray.mDirection(1) / ray.mDirection(0));
-              auto angleZ = std::atan(ray.mDirection(2) / ray.mDirection(0));
-              sum += localMedium.trace(ray);
+        std::fill(sums.begin(), sums.end(), 0.0);
+        for(uint32_t j = 1u; j <= mSubSample; ++j) {
+          traceGridRow(y, j, current);
+          for(uint32_t h = 0u; h + 1u < gridWidth; ++h) {
+            std::array<Vertex const*, 4u> corners = { &previous[h], &previous[h + 1u], &current[h], &current[h + 1u] };
+            bool valid = true;
+            std::array<double, 4u> texels;
+            for(uint32_t k = 0u; k < corners.size(); ++k) {
+              valid = valid && !std::isnan((*corners[k])(0));
+              texels[k] = (valid ? mMedium.getPixel(*corners[k]) : 0.0);
+            }
+            if(valid) {
+              auto area = [this](Vertex const& aA, Vertex const& aB, Vertex const& aC) {
+                double const distance = (aA(0) - mPinhole(0)) / csSurfPinholeDist;
+                return std::abs((aB(1) - aA(1)) * (aC(2) - aA(2)) - (aB(2) - aA(2)) * (aC(1) - aA(1))) / 2.0 / (distance * distance);
+              };
+              sums[h / mSubSample] += area(*corners[0], *corners[1], *corners[2]) * (texels[0] + texels[1] + texels[2]) / 3.0 +
+                                      area(*corners[1], *corners[3], *corners[2]) * (texels[1] + texels[3] + texels[2]) / 3.0;
             }
+            else {} // nothing to do
           }
-          uint8_t color;
-          color = std::max(csColorBlack, static_cast<uint8_t>(::round(sum / static_cast<double>(mSubSample * mSubSample))));
-          mBuffer[(mImage.get_width() - z - 1u) + mImage.get_width() * (mImage.get_height() - y - 1u)] = color;
+          std::swap(previous, current);
+        }
+        for(int z = 0; z < width; ++z) {
+          mBuffer[getPixelIndex(y, mMirageDeep + z)] = sums[z] / (straightArea * mSubSample * mSubSample);
         }
       }
     });
@@ -316,13 +1331,326 @@ void Image::calculateMirage() {
   for (auto& t : threads) {
     t.join();
   }
-  for(int y = 0; y < mImage.get_height(); ++y) {
-    for(int z = 0; z < mImage.get_width(); ++z) {
-      auto color = mBuffer[y * mImage.get_width() + z];
-      if(color != csColorVoid) {
-        mImage.set_pixel(z, y, color);
+  mMirageRayCount = static_cast<uint64_t>(gridWidth) * ((mMirageTop - mMirageBottom) * mSubSample + nThreads);
+  mMirageSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// The columns are traced from left to right, so a mirrored one comes after its partner.
+void Image::traceRow(Medium &aMedium, int const aY, Medium * const aLoose, std::vector<Vertex> &aRowHits) {
+  uint32_t const rayCount = mSubSample * mSubSample;
+  aRowHits.resize(static_cast<size_t>(std::max(0, mMirageShallow - mMirageDeep)) * rayCount);
+  RungeKuttaRayBending::StepSchedule schedule;
+  RungeKuttaRayBending::Result previous;
+  previous.mValid = false;
+  for(int z = mMirageDeep; z < mMirageShallow; ++z) {
+    int const partner = mFrameWidth - 1 - z;
+    if(mMirrorColumns && partner >= mMirageDeep && partner < z) {
+      mirrorPixel(aY, z, &aRowHits[(partner - mMirageDeep) * rayCount]);
+    }
+    else {
+      tracePixel(aMedium, aY, z, schedule, aLoose, &previous, mMirrorColumns ? &aRowHits[(z - mMirageDeep) * rayCount] : nullptr);
+    }
+  }
+}
+
+void Image::mirrorPixel(int const aY, int const aZ, Vertex const * const aHits) {
+  int const partner = mFrameWidth - 1 - aZ;
+  bool const keepHits = !mHits.mValid.empty();
+  bool const retainHits = !mRetained.empty();
+  uint32_t const rayWidth = mImage.get_width() * mSubSample;
+  double sum = 0.0;
+  for(uint32_t i = 0; i < mSubSample; ++i) {
+    for(uint32_t j = 0; j < mSubSample; ++j) {
+      auto const& mirrored = aHits[(mSubSample - 1u - i) * mSubSample + j];
+      Vertex hit(mirrored(0), mirrored(1), -mirrored(2));
+      bool const valid = !std::isnan(hit(0));
+      sum += (valid ? mMedium.getPixel(hit) : 0u);
+      auto index = ((mImage.get_width() - aZ - 1u) * mSubSample + mSubSample - 1u - i) +
+                   ((mImage.get_height() - aY - 1u) * mSubSample + mSubSample - 1u - j) * rayWidth;
+      if(retainHits && valid) {
+        mRetained[index] = hit;
+      }
+      else {} // nothing to do
+      if(keepHits) {
+        auto source = ((mImage.get_width() - partner - 1u) * mSubSample + i) +
+                      ((mImage.get_height() - aY - 1u) * mSubSample + mSubSample - 1u - j) * rayWidth;
+        mHits.mY[index]         = mHits.mY[source];
+        mHits.mZ[index]         = -mHits.mZ[source];
+        mHits.mStepCount[index] = mHits.mStepCount[source];
+        mHits.mValid[index]     = mHits.mValid[source];
+      }
+      else {} // nothing to do
+    }
+  }
+  mBuffer[getPixelIndex(aY, aZ)] = sum / static_cast<double>(mSubSample * mSubSample);
+}
+
+void Image::tracePixel(Medium &aMedium, int const aY, int const aZ, RungeKuttaRayBending::StepSchedule &aSchedule, Medium * const aLoose,
+                       RungeKuttaRayBending::Result * const aPrevious, Vertex * const aHits) {
+#ifdef SOLVER_STATISTICS
+  auto const statisticsBefore = gSolverStatistics;
+#endif
+  Ray ray;
+  ray.mStart = mPinhole;
+  RungeKuttaRayBending::Result hit;
+  Medium * const loose = (aLoose != nullptr && !isTightRow(aY) ? aLoose : nullptr);
+  RungeKuttaRayBending::Result ownPrevious;
+  ownPrevious.mValid = false;
+  auto &previous = (aPrevious != nullptr ? *aPrevious : ownPrevious);
+  double sum = 0.0;
+  for(uint32_t i = 0; i < mSubSample; ++i) {
+    for(uint32_t j = 0; j < mSubSample; ++j) {
+      ray.mDirection = getRayDirection(aY, aZ, i, j);
+      auto const hint = (mStepHints && aSchedule.mCount > 0u ? &aSchedule : nullptr);
+      uint8_t value;
+      if(loose != nullptr) {
+        // The loose hit is kept only where a small error can't change the texel: valid, away from
+        // texel boundaries, and close to the previous hit of the row.
+        value = loose->trace(ray, hit, RungeKuttaRayBending::csMaxStep, hint);
+        if(!hit.mValid || mMedium.getTexelMargin(hit.mValue) < csLooseTexelMargin ||
+           (previous.mValid && mMedium.getTexelDistance(hit.mValue, previous.mValue) > csLooseDivergence)) {
+          value = aMedium.trace(ray, hit, RungeKuttaRayBending::csMaxStep, hint);
+        }
+        else {} // nothing to do
+        previous = hit;
+      }
+      else {
+        value = aMedium.trace(ray, hit, RungeKuttaRayBending::csMaxStep, hint);
+      }
+      sum += value;
+      if(hit.mValid) {
+        aSchedule = hit.mSchedule;
+      }
+      else {} // nothing to do
+      if(aHits != nullptr) {
+        aHits[i * mSubSample + j] = (hit.mValid ? hit.mValue : Vertex::Constant(std::nan("")));
+      }
+      else {} // nothing to do
+      storeHit(aY, aZ, i, j, hit);
+    }
+  }
+  mBuffer[getPixelIndex(aY, aZ)] = sum / static_cast<double>(mSubSample * mSubSample);
+#ifdef SOLVER_STATISTICS
+  mPixelStatistics[getPixelIndex(aY, aZ)] += gSolverStatistics - statisticsBefore;
+#endif
+}
+
+Vector Image::getRayDirection(int const aY, int const aZ, uint32_t const aI, uint32_t const aJ) const {
+  Vertex subpixel = mCenter + mPixelSize * (
+        (aZ - mBiasZ + mSsFactor * (aI - mBiasSub)) * mInPlaneZ +
+        (aY - mBiasY + mSsFactor * (aJ - mBiasSub)) * mInPlaneY);
+  return (mPinhole - subpixel).normalized();
+}
+
+void Image::storeHit(int const aY, int const aZ, uint32_t const aI, uint32_t const aJ, RungeKuttaRayBending::Result const& aHit) {
+  uint32_t const rayWidth = mImage.get_width() * mSubSample;
+  auto index = ((mImage.get_width() - aZ - 1u) * mSubSample + mSubSample - 1u - aI) +
+               ((mImage.get_height() - aY - 1u) * mSubSample + mSubSample - 1u - aJ) * rayWidth;
+  if(!mRetained.empty() && aHit.mValid) {
+    mRetained[index] = aHit.mValue;
+  }
+  else {} // nothing to do
+  if(!mHits.mValid.empty()) {
+    mHits.mY[index]         = aHit.mValue(1);
+    mHits.mZ[index]         = aHit.mValue(2);
+    mHits.mStepCount[index] = aHit.mStepCount;
+    mHits.mValid[index]     = (aHit.mValid ? 1u : 0u);
+  }
+  else {} // nothing to do
+}
+
+// Traces the pixel center and copies the hit to all subsample rays. Returns true if the ray exceeded aMaxStep.
+bool Image::traceCoarse(Medium &aMedium, int const aY, int const aZ, uint32_t const aMaxStep, uint32_t &aStepCount, RungeKuttaRayBending::StepSchedule &aSchedule) {
+#ifdef SOLVER_STATISTICS
+  auto const statisticsBefore = gSolverStatistics;
+#endif
+  Ray ray;
+  ray.mStart = mPinhole;
+  RungeKuttaRayBending::Result hit;
+  Vertex pixel = mCenter + mPixelSize * ((aZ - mBiasZ) * mInPlaneZ + (aY - mBiasY) * mInPlaneY);
+  ray.mDirection = (mPinhole - pixel).normalized();
+  mBuffer[getPixelIndex(aY, aZ)] = aMedium.trace(ray, hit, aMaxStep, mStepHints && aSchedule.mCount > 0u ? &aSchedule : nullptr);
+  if(hit.mValid) {
+    aSchedule = hit.mSchedule;
+  }
+  else {} // nothing to do
+#ifdef SOLVER_STATISTICS
+  mPixelStatistics[getPixelIndex(aY, aZ)] += gSolverStatistics - statisticsBefore;
+#endif
+  uint32_t const rayWidth = mImage.get_width() * mSubSample;
+  for(uint32_t i = 0; i < mSubSample; ++i) {
+    for(uint32_t j = 0; j < mSubSample; ++j) {
+      auto index = ((mImage.get_width() - aZ - 1u) * mSubSample + mSubSample - 1u - i) +
+                   ((mImage.get_height() - aY - 1u) * mSubSample + mSubSample - 1u - j) * rayWidth;
+      if(!mRetained.empty() && hit.mValid) {
+        mRetained[index] = hit.mValue;
+      }
+      else {} // nothing to do
+      if(!mHits.mValid.empty()) {
+        mHits.mY[index]         = hit.mValue(1);
+        mHits.mZ[index]         = hit.mValue(2);
+        mHits.mStepCount[index] = hit.mStepCount;
+        mHits.mValid[index]     = (hit.mValid ? 1u : 0u);
+      }
+      else {} // nothing to do
+    }
+  }
+  aStepCount = hit.mStepCount;
+  return !hit.mValid && hit.mStepCount >= aMaxStep;
+}
+
+// The bands in the journal are restored into the mirage rows, which the surface leaves alone. A torn record
+// at the end, left by an interruption, is cut off. The missing bands are traced like in calculateMirage,
+// taken by the threads one by one, and appended as soon as they are complete.
+void Image::calculateMirageJournaled(uint32_t const aThreadCount) {
+  uint32_t const width = mImage.get_width();
+  uint32_t const height = mImage.get_height();
+  int file = open(mNameJournal.c_str(), O_RDWR);
+  struct stat status;
+  if(file < 0 || fstat(file, &status) != 0) {
+    throw std::runtime_error("Can't open journal " + mNameJournal);
+  }
+  else {} // nothing to do
+  uint64_t const size = status.st_size;
+  uint64_t valid = csJournalHeaderSize;
+  std::vector<uint8_t> restored(height, 0u);
+  void *mapped = (size > valid ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED);
+  if(mapped != MAP_FAILED) {
+    auto const bytes = static_cast<char const*>(mapped);
+    while(valid + 3u * sizeof(uint32_t) <= size) {
+      auto const record = bytes + valid;
+      uint32_t const rowBegin = readLittleEndian(record + 4u);
+      uint32_t const rowCount = readLittleEndian(record + 8u);
+      if(readLittleEndian(record) != csJournalMarker || rowBegin > height || rowCount > height - rowBegin) {
+        break;
+      }
+      else {} // nothing to do
+      uint64_t const payloadSize = static_cast<uint64_t>(rowCount) * width * sizeof(float);
+      auto const payload = record + 3u * sizeof(uint32_t);
+      if(valid + 4u * sizeof(uint32_t) + payloadSize > size || readLittleEndian(payload + payloadSize) != getChecksum(payload, payloadSize)) {
+        break;
       }
       else {} // nothing to do
+      for(uint32_t i = 0u; i < rowCount * width; ++i) {
+        uint32_t bits = readLittleEndian(payload + i * sizeof(float));
+        std::memcpy(&mBuffer[rowBegin * width + i], &bits, sizeof(float));
+      }
+      std::fill(restored.begin() + rowBegin, restored.begin() + rowBegin + rowCount, 1u);
+      valid += 4u * sizeof(uint32_t) + payloadSize;
+    }
+    munmap(mapped, size);
+  }
+  else {} // nothing to do
+  if(ftruncate(file, valid) != 0 || lseek(file, 0, SEEK_END) < 0) {
+    close(file);
+    throw std::runtime_error("Can't cut journal " + mNameJournal);
+  }
+  else {} // nothing to do
+
+  std::vector<int> bands;   // First rows of the missing ones.
+  uint64_t rowCount = 0u;
+  for(int y = mMirageBottom; y < mMirageTop; y += csJournalBand) {
+    int yEnd = std::min(y + csJournalBand, mMirageTop);
+    bool done = true;
+    for(int row = y; row < yEnd; ++row) {
+      done = done && restored[height - row - 1] != 0u;
+    }
+    if(!done) {
+      bands.push_back(y);
+      rowCount += yEnd - y;
+    }
+    else {} // nothing to do
+  }
+  mMirageRayCount = rowCount * getTracedColumnCount() * mSubSample * mSubSample;
+
+  std::atomic<uint32_t> next = 0u;
+  std::mutex mutex;
+  bool failed = false;
+  std::vector<std::thread> threads(aThreadCount);
+  for (uint32_t i = 0u; i < aThreadCount; ++i) {
+    threads[i] = std::thread([this, &bands, &next, &mutex, &failed, file, width, height, i] {
+      Profiler::ThreadScope profile(mProfiler, i);
+      Medium localMedium(mMedium);
+      std::optional<Medium> looseMedium;
+      if(mTolLoose != 1.0 || mPrecision != RungeKuttaRayBending::Precision::cDouble) {
+        looseMedium.emplace(mMedium, mTolLoose, mPrecision);
+      }
+      else {} // nothing to do
+      std::vector<char> bytes;
+      std::vector<Vertex> rowHits;
+      for(uint32_t band = next++; band < bands.size(); band = next++) {
+        int const yEnd = std::min(bands[band] + csJournalBand, mMirageTop);
+        for(int y = bands[band]; y < yEnd; ++y) {
+          traceRow(localMedium, y, looseMedium ? &*looseMedium : nullptr, rowHits);
+        }
+        uint32_t const rowBegin = height - yEnd;
+        bytes.clear();
+        appendLittleEndian(bytes, csJournalMarker);
+        appendLittleEndian(bytes, rowBegin);
+        appendLittleEndian(bytes, static_cast<uint32_t>(yEnd - bands[band]));
+        for(uint32_t k = rowBegin * width; k < (height - bands[band]) * width; ++k) {
+          appendLittleEndian(bytes, mBuffer[k]);
+        }
+        appendLittleEndian(bytes, getChecksum(bytes.data() + 3u * sizeof(uint32_t), bytes.size() - 3u * sizeof(uint32_t)));
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!failed && (!writeAll(file, bytes.data(), bytes.size()) || fdatasync(file) != 0)) {
+          std::cerr << "Can't append to journal " << mNameJournal << ", rendering goes on without checkpoints.\n";
+          failed = true;
+        }
+        else {} // nothing to do
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  close(file);
+}
+
+// aOrder holds mirage area pixel indices, the ones from aRefinedCount on kept their coarse value.
+// These are summed up in tiles of the output image, merging neighbouring tiles of a tile row.
+void Image::collectUnderRefined(std::vector<uint32_t> const& aOrder, uint32_t const aRefinedCount, int const aWidth) {
+  int const tilesX = (mImage.get_width() + csRefineTile - 1) / csRefineTile;
+  int const tilesY = (mImage.get_height() + csRefineTile - 1) / csRefineTile;
+  std::vector<uint32_t> counts(tilesX * tilesY, 0u);
+  for(uint32_t k = aRefinedCount; k < aOrder.size(); ++k) {
+    int x = mFrameWidth - (mMirageDeep + aOrder[k] % aWidth) - 1 - mWindowX;
+    int y = mFrameHeight - (mMirageBottom + aOrder[k] / aWidth) - 1 - mWindowY;
+    ++counts[x / csRefineTile + tilesX * (y / csRefineTile)];
+  }
+  for(int ty = 0; ty < tilesY; ++ty) {
+    for(int tx = 0; tx < tilesX; ++tx) {
+      auto count = counts[tx + tilesX * ty];
+      if(count > 0u) {
+        if(!mUnderRefined.empty() && mUnderRefined.back().mY == ty * csRefineTile && mUnderRefined.back().mX + mUnderRefined.back().mWidth == tx * csRefineTile) {
+          mUnderRefined.back().mWidth = std::min<int>(mImage.get_width(), (tx + 1) * csRefineTile) - mUnderRefined.back().mX;
+          mUnderRefined.back().mCount += count;
+        }
+        else {
+          mUnderRefined.push_back(Region{tx * csRefineTile, ty * csRefineTile,
+                                         std::min<int>(mImage.get_width(), (tx + 1) * csRefineTile) - tx * csRefineTile,
+                                         std::min<int>(mImage.get_height(), (ty + 1) * csRefineTile) - ty * csRefineTile,
+                                         count});
+        }
+      }
+      else {} // nothing to do
+    }
+  }
+}
+
+void Image::shadeMirage() {
+  uint32_t const rayWidth = mImage.get_width() * mSubSample;
+  for(int y = mLimitPixelBottom; y < mLimitPixelTop; ++y) {
+    for(int z = mLimitPixelDeep; z < mLimitPixelShallow; ++z) {
+      double sum = 0.0;
+      for(uint32_t i = 0; i < mSubSample; ++i) {
+        for(uint32_t j = 0; j < mSubSample; ++j) {
+          auto const& hit = mRetained[((mImage.get_width() - z - 1u) * mSubSample + mSubSample - 1u - i) +
+                                      ((mImage.get_height() - y - 1u) * mSubSample + mSubSample - 1u - j) * rayWidth];
+          sum += (std::isnan(hit(0)) ? 0u : mMedium.getPixel(hit));
+        }
+      }
+      mBuffer[(mImage.get_width() - z - 1u) + mImage.get_width() * (mImage.get_height() - y - 1u)] = sum / static_cast<double>(mSubSample * mSubSample);
     }
   }
 }
@@ -335,20 +1663,325 @@ void Image::drawMarks(int const aMirrorHeight) {
     if(mMarkAcross || z < mLimitPixelDeep * mMarkIndent || z > mImage.get_width() - mLimitPixelDeep * mMarkIndent) {
       auto height = aMirrorHeight + y;
       if(height >= 0 && height < mImage.get_width() && (z % dashLength < dashLimit)) {
-        mImage.set_pixel(z, mImage.get_height() - 1 - height, csColorMirror);
+        mMarks[z + mImage.get_width() * (mImage.get_height() - 1 - height)] = csColorMirror;
       }
       else {} // nothing to do
       height = mLimitPixelBaseTop + y;
       if(height >= 0 && height < mImage.get_width() && (z % dashLength >= dashLimit)) {
-        mImage.set_pixel(z, mImage.get_height() - 1 - height, csColorBase);
+        mMarks[z + mImage.get_width() * (mImage.get_height() - 1 - height)] = csColorBase;
       }
       else {} // nothing to do
       height = mLimitPixelBaseBottom + y;
       if(height >= 0 && height < mImage.get_width() && (z % dashLength >= dashLimit)) {
-        mImage.set_pixel(z, mImage.get_height() - 1 - height, csColorBase);
+        mMarks[z + mImage.get_width() * (mImage.get_height() - 1 - height)] = csColorBase;
       }
       else {} // nothing to do
     }
     else {} // nothing to do
   }
 }
+
+uint8_t Image::getIndexed(uint32_t const aIndex, bool const aBurnMarks) const {
+  uint8_t result;
+  auto value = mBuffer[aIndex];
+  if(aBurnMarks && mMarks[aIndex] != csColorVoid) {
+    result = mMarks[aIndex];
+  }
+  else if(!std::isnan(value)) {
+    result = std::max(csColorBlack, static_cast<uint8_t>(::round(value)));
+  }
+  else {
+    result = csColorVoid;
+  }
+  return result;
+}
+
+void Image::writeIndexed8(char const * const aName, bool const aBurnMarks) {
+  for(int y = 0; y < mImage.get_height(); ++y) {
+    for(int z = 0; z < mImage.get_width(); ++z) {
+      mImage.set_pixel(z, y, getIndexed(y * mImage.get_width() + z, aBurnMarks));  // Also overwrites marks burnt by an earlier write.
+    }
+  }
+  mImage.write(aName);
+}
+
+void Image::writeGray16(char const * const aName) const {
+  png::image<png::gray_pixel_16> image(mImage.get_width(), mImage.get_height());
+  for(int y = 0; y < mImage.get_height(); ++y) {
+    for(int z = 0; z < mImage.get_width(); ++z) {
+      auto value = mBuffer[y * mImage.get_width() + z];
+      image.set_pixel(z, y, std::isnan(value) ? 0u : static_cast<uint16_t>(::round(value * 257.0)));
+    }
+  }
+  image.write(aName);
+}
+
+// Portable float map, rows go from bottom to top, negative scale means little-endian.
+void Image::writeFloat32(char const * const aName) const {
+  std::vector<char> bytes;
+  bytes.reserve(mBuffer.size() * sizeof(float));
+  for(int y = mImage.get_height() - 1; y >= 0; --y) {
+    for(int z = 0; z < mImage.get_width(); ++z) {
+      appendLittleEndian(bytes, mBuffer[y * mImage.get_width() + z] / 255.0f);
+    }
+  }
+  std::ofstream out(aName, std::ios::binary);
+  out << "Pf\n" << mImage.get_width() << ' ' << mImage.get_height() << "\n-1.0\n";
+  out.write(bytes.data(), bytes.size());
+}
+
+// Little-endian layout for direct mmap in analysis tools:
+//   char[8]  "MIRAGEHB"
+//   uint32   version, ray grid width, ray grid height, subsample, header size, reserved
+//   float32  billboard Y of each ray [width * height]  NaN for rays not traced
+//   float32  billboard Z of each ray [width * height]
+//   uint32   solver step count [width * height]
+//   uint8    validity [width * height]
+// The ray grid is the image grid subsampled, row 0 is the top.
+void Image::writeRaw(char const * const aName) const {
+  std::vector<char> bytes;
+  bytes.insert(bytes.end(), { 'M', 'I', 'R', 'A', 'G', 'E', 'H', 'B' });
+  appendLittleEndian(bytes, csRawVersion);
+  appendLittleEndian(bytes, mImage.get_width() * mSubSample);
+  appendLittleEndian(bytes, mImage.get_height() * mSubSample);
+  appendLittleEndian(bytes, mSubSample);
+  appendLittleEndian(bytes, csRawHeaderSize);
+  appendLittleEndian(bytes, 0u);
+  bytes.reserve(csRawHeaderSize + mHits.mValid.size() * (2u * sizeof(float) + sizeof(uint32_t) + sizeof(uint8_t)));
+  for(auto value : mHits.mY) {
+    appendLittleEndian(bytes, value);
+  }
+  for(auto value : mHits.mZ) {
+    appendLittleEndian(bytes, value);
+  }
+  for(auto value : mHits.mStepCount) {
+    appendLittleEndian(bytes, value);
+  }
+  bytes.insert(bytes.end(), mHits.mValid.begin(), mHits.mValid.end());
+  std::ofstream out(aName, std::ios::binary);
+  out.write(bytes.data(), bytes.size());
+}
+
+void Image::writeMarks(char const * const aName) const {
+  png::image<png::index_pixel> image(mImage.get_width(), mImage.get_height());
+  image.set_palette(mPalette);
+  for(int y = 0; y < mImage.get_height(); ++y) {
+    for(int z = 0; z < mImage.get_width(); ++z) {
+      image.set_pixel(z, y, mMarks[y * mImage.get_width() + z]);
+    }
+  }
+  image.write(aName);
+}
+
+// Text, doubles with full precision so every process gets the same geometry.
+void Image::writeState(char const * const aName, bool const aRenderSurface) const {
+  std::ofstream out(aName);
+  out << std::setprecision(17)
+      << "MIRAGESTATE " << csStateVersion << '\n'
+      << "resolution " << mImage.get_width() << ' ' << mImage.get_height() << '\n'
+      << "surface " << aRenderSurface << '\n'
+      << "bias " << mBiasZ << ' ' << mBiasY << '\n'
+      << "pixelSize " << mPixelSize << '\n'
+      << "limits " << mLimitPixelTop << ' ' << mLimitPixelBottom << ' ' << mLimitPixelBaseTop << ' ' << mLimitPixelBaseBottom << ' '
+                   << mLimitPixelBaseBottomSurf << ' ' << mLimitPixelDeep << ' ' << mLimitPixelShallow << '\n'
+      << "mirror " << mMirrorHeight << '\n';
+  if(!out) {
+    throw std::runtime_error(std::string("Can't write tile state ") + aName);
+  }
+  else {} // nothing to do
+}
+
+bool Image::readState(char const * const aName) {
+  std::ifstream in(aName);
+  std::string magic;
+  std::string key;
+  uint32_t version = 0u;
+  uint32_t resolutionX = 0u;
+  uint32_t resolutionY = 0u;
+  bool renderSurface = false;
+  in >> magic >> version >> key >> resolutionX >> resolutionY >> key >> renderSurface >> key >> mBiasZ >> mBiasY >> key >> mPixelSize
+     >> key >> mLimitPixelTop >> mLimitPixelBottom >> mLimitPixelBaseTop >> mLimitPixelBaseBottom
+            >> mLimitPixelBaseBottomSurf >> mLimitPixelDeep >> mLimitPixelShallow >> key >> mMirrorHeight;
+  if(!in || magic != "MIRAGESTATE" || version != csStateVersion || resolutionX != mResolutionX) {
+    throw std::runtime_error(std::string("Tile state missing, corrupt or of other resolution: ") + aName);
+  }
+  else {} // nothing to do
+  resizeBuffers(mResolutionX, resolutionY);
+  return renderSurface;
+}
+
+// Little-endian, only the buffer rows holding values:
+//   char[8]  "MIRAGETL"
+//   uint32   version, image width, image height, first row, row count
+//   float32  texel values [width * row count]  NaN for void
+// Texel values are kept as they are, so merging is exact.
+void Image::writeTile(char const * const aName) const {
+  uint32_t const width = mImage.get_width();
+  uint32_t const height = mImage.get_height();
+  auto isEmpty = [this, width](uint32_t const aRow) {
+    return std::all_of(mBuffer.begin() + aRow * width, mBuffer.begin() + (aRow + 1u) * width, [](float const aValue) { return std::isnan(aValue); });
+  };
+  uint32_t rowBegin = 0u;
+  while(rowBegin < height && isEmpty(rowBegin)) {
+    ++rowBegin;
+  }
+  uint32_t rowEnd = height;
+  while(rowEnd > rowBegin && isEmpty(rowEnd - 1u)) {
+    --rowEnd;
+  }
+  std::vector<char> bytes;
+  bytes.reserve(csTileHeaderSize + (rowEnd - rowBegin) * width * sizeof(float));
+  bytes.insert(bytes.end(), { 'M', 'I', 'R', 'A', 'G', 'E', 'T', 'L' });
+  appendLittleEndian(bytes, csTileVersion);
+  appendLittleEndian(bytes, width);
+  appendLittleEndian(bytes, height);
+  appendLittleEndian(bytes, rowBegin);
+  appendLittleEndian(bytes, rowEnd - rowBegin);
+  for(auto i = mBuffer.begin() + rowBegin * width; i != mBuffer.begin() + rowEnd * width; ++i) {
+    appendLittleEndian(bytes, *i);
+  }
+  std::ofstream out(aName, std::ios::binary);
+  out.write(bytes.data(), bytes.size());
+  if(!out) {
+    throw std::runtime_error(std::string("Can't write tile ") + aName);
+  }
+  else {} // nothing to do
+}
+
+// Values present in the tile overwrite the buffer.
+void Image::readTile(char const * const aName) {
+  std::ifstream in(aName, std::ios::binary);
+  std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  uint32_t const width = mImage.get_width();
+  uint32_t const height = mImage.get_height();
+  bool valid = (bytes.size() >= csTileHeaderSize && std::equal(bytes.begin(), bytes.begin() + 8u, "MIRAGETL") &&
+                readLittleEndian(&bytes[8u]) == csTileVersion && readLittleEndian(&bytes[12u]) == width && readLittleEndian(&bytes[16u]) == height);
+  uint32_t const rowBegin = (valid ? readLittleEndian(&bytes[20u]) : 0u);
+  uint32_t const rowCount = (valid ? readLittleEndian(&bytes[24u]) : 0u);
+  if(!valid || rowBegin > height || rowCount > height - rowBegin || bytes.size() != csTileHeaderSize + static_cast<uint64_t>(rowCount) * width * sizeof(float)) {
+    throw std::runtime_error(std::string("Tile missing, corrupt or of other size: ") + aName);
+  }
+  else {} // nothing to do
+  for(uint32_t i = 0u; i < rowCount * width; ++i) {
+    uint32_t bits = readLittleEndian(&bytes[csTileHeaderSize + i * sizeof(float)]);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    if(!std::isnan(value)) {
+      mBuffer[rowBegin * width + i] = value;
+    }
+    else {} // nothing to do
+  }
+}
+
+// Little-endian, the header written once the geometry is known:
+//   char[8]  "MIRAGEJL"
+//   uint32   version, image width, image height, surface rendered
+//   uint64   parameter hash
+//   float64  bias Z, bias Y, pixel size
+//   int32    pixel limits top, bottom, base top, base bottom, base bottom surface, deep, shallow, mirror height
+// followed by the bands of mirage rows as they complete, in any order:
+//   uint32   csJournalMarker, first row, row count
+//   float32  texel values [width * row count]  NaN for void
+//   uint32   FNV-1a of the texel value bytes
+// Rows are those of the output image, row 0 is the top.
+void Image::writeJournalHeader(bool const aRenderSurface) const {
+  std::vector<char> bytes;
+  bytes.insert(bytes.end(), { 'M', 'I', 'R', 'A', 'G', 'E', 'J', 'L' });
+  appendLittleEndian(bytes, csJournalVersion);
+  appendLittleEndian(bytes, static_cast<uint32_t>(mImage.get_width()));
+  appendLittleEndian(bytes, static_cast<uint32_t>(mImage.get_height()));
+  appendLittleEndian(bytes, aRenderSurface ? 1u : 0u);
+  appendLittleEndian(bytes, mJournalHash);
+  for(auto value : { mBiasZ, mBiasY, mPixelSize }) {
+    appendLittleEndian(bytes, value);
+  }
+  for(auto value : { mLimitPixelTop, mLimitPixelBottom, mLimitPixelBaseTop, mLimitPixelBaseBottom, mLimitPixelBaseBottomSurf,
+                     mLimitPixelDeep, mLimitPixelShallow, mMirrorHeight }) {
+    appendLittleEndian(bytes, static_cast<uint32_t>(value));
+  }
+  std::ofstream out(mNameJournal, std::ios::binary | std::ios::trunc);
+  out.write(bytes.data(), bytes.size());
+  out.flush();
+  if(!out) {
+    throw std::runtime_error("Can't write journal " + mNameJournal);
+  }
+  else {} // nothing to do
+}
+
+bool Image::readJournalHeader(bool const aRenderSurface) {
+  std::ifstream in(mNameJournal, std::ios::binary);
+  char header[csJournalHeaderSize];
+  if(!in.read(header, csJournalHeaderSize)) {
+    return false;   // Missing, or interrupted before the geometry was complete.
+  }
+  else {} // nothing to do
+  if(!std::equal(header, header + 8u, "MIRAGEJL") || readLittleEndian(header + 8u) != csJournalVersion ||
+     readLittleEndian(header + 12u) != mResolutionX || readLittleEndian(header + 20u) != (aRenderSurface ? 1u : 0u) ||
+     readLittleEndian64(header + 24u) != mJournalHash) {
+    throw std::runtime_error("Journal " + mNameJournal + " belongs to other parameters, remove it or choose another name.");
+  }
+  else {} // nothing to do
+  resizeBuffers(mResolutionX, readLittleEndian(header + 16u));
+  mBiasZ                    = readLittleEndianDouble(header + 32u);
+  mBiasY                    = readLittleEndianDouble(header + 40u);
+  mPixelSize                = readLittleEndianDouble(header + 48u);
+  mLimitPixelTop            = static_cast<int32_t>(readLittleEndian(header + 56u));
+  mLimitPixelBottom         = static_cast<int32_t>(readLittleEndian(header + 60u));
+  mLimitPixelBaseTop        = static_cast<int32_t>(readLittleEndian(header + 64u));
+  mLimitPixelBaseBottom     = static_cast<int32_t>(readLittleEndian(header + 68u));
+  mLimitPixelBaseBottomSurf = static_cast<int32_t>(readLittleEndian(header + 72u));
+  mLimitPixelDeep           = static_cast<int32_t>(readLittleEndian(header + 76u));
+  mLimitPixelShallow        = static_cast<int32_t>(readLittleEndian(header + 80u));
+  mMirrorHeight             = static_cast<int32_t>(readLittleEndian(header + 84u));
+  return true;
+}
+
+// Full frame output image coordinates, where ROI pixel x, y has its centre at
+// window x + (x + 0.5) / zoom - 0.5, window y + (y + 0.5) / zoom - 0.5.
+void Image::writeRoiInfo(char const * const aName, int const aLeft, int const aTop, int const aRight, int const aBottom, uint32_t const aZoom) const {
+  int const height = mImage.get_height();
+  std::ofstream out(aName);
+  out << "{\n  \"frame\": { \"width\": " << mImage.get_width() << ", \"height\": " << height << " },"
+      << "\n  \"window\": { \"x\": " << aLeft << ", \"y\": " << aTop << ", \"width\": " << aRight - aLeft << ", \"height\": " << aBottom - aTop << " },"
+      << "\n  \"zoom\": " << aZoom << ','
+      << "\n  \"mirage\": { \"x\": " << mImage.get_width() - mLimitPixelShallow << ", \"y\": " << height - mLimitPixelTop
+      << ", \"width\": " << mLimitPixelShallow - mLimitPixelDeep << ", \"height\": " << mLimitPixelTop - mLimitPixelBottom << " },"
+      << "\n  \"rows\": { \"mirror\": " << (mMirrorHeight >= 0 ? std::to_string(height - 1 - mMirrorHeight) : "null") << ", \"baseTop\": " << height - 1 - mLimitPixelBaseTop
+      << ", \"baseBottom\": " << height - 1 - mLimitPixelBaseBottom << " }\n}\n";
+  if(!out) {
+    throw std::runtime_error(std::string("Can't write ROI info ") + aName);
+  }
+  else {} // nothing to do
+}
+
+void Image::writeStatistics(char const * const aPrefix) const {
+#ifdef SOLVER_STATISTICS
+  SolverStatistics total;
+  SolverStatistics maximum;
+  for(auto const& pixel : mPixelStatistics) {
+    total += pixel;
+    for(uint32_t i = 0u; i < SolverStatistics::cCount; ++i) {
+      maximum.mCounts[i] = std::max(maximum.mCounts[i], pixel.mCounts[i]);
+    }
+  }
+  for(uint32_t i = 0u; i < SolverStatistics::cCount; ++i) {
+    png::image<png::gray_pixel_16> image(mImage.get_width(), mImage.get_height());
+    for(int y = 0; y < mImage.get_height(); ++y) {
+      for(int z = 0; z < mImage.get_width(); ++z) {
+        image.set_pixel(z, y, static_cast<uint16_t>(std::min<uint64_t>(mPixelStatistics[y * mImage.get_width() + z].mCounts[i], 65535u)));
+      }
+    }
+    image.write(std::string(aPrefix) + '-' + SolverStatistics::csNames[i] + ".png");
+  }
+  std::ofstream out(std::string(aPrefix) + ".json");
+  out << "{\n  \"rays\": " << mMirageRayCount << ",\n  \"counters\": {";
+  for(uint32_t i = 0u; i < SolverStatistics::cCount; ++i) {
+    out << (i == 0u ? "\n" : ",\n") << "    \"" << SolverStatistics::csNames[i] << "\": { \"total\": " << total.mCounts[i]
+        << ", \"perRay\": " << (mMirageRayCount == 0u ? 0.0 : static_cast<double>(total.mCounts[i]) / mMirageRayCount)
+        << ", \"maxPerPixel\": " << maximum.mCounts[i] << " }";
+  }
+  out << "\n  }\n}\n";
+#else
+  std::cerr << "Solver statistics not written to " << aPrefix << ", compile with -DSOLVER_STATISTICS=ON to collect them.\n";
+#endif
+}
@@ -5,8 +5,15 @@
 
 #include "RungeKuttaRayBending.h"
 #include "3dGeomUtil.h"
+#include "Profiler.h"
+#include "TaskGraph.h"
 #include "png.hpp"
+#include <array>
+#include <chrono>
+#include <functional>
+#include <limits>
 #include <optional>
+#include <string>
 
 
 class Object final {
@@ -21,52 +28,152 @@ private:
   double const mX;
 
 public:
-  Object(char const * const aName, double const aDispX, double const aLiftY, double const aHeight, double const aEarthRadius);
+  static constexpr double csCullSlope = 0.02;  // bound of the direction change of a ray on the way to the object
+
+  // aCenterZ shifts the object sideways, positive to the left in the image.
+  Object(char const * const aName, double const aDispX, double const aLiftY, double const aHeight, double const aEarthRadius, double const aCenterZ = 0.0)
+  : Object(png::image<png::gray_pixel>(aName), aDispX, aLiftY, aHeight, aEarthRadius, aCenterZ) {}
+  Object(png::image<png::gray_pixel> const &aImage, double const aDispX, double const aLiftY, double const aHeight, double const aEarthRadius,
+         double const aCenterZ = 0.0);
+  // Only possible with the same size, because the size determines the geometry.
+  bool    replaceImage(png::image<png::gray_pixel> const &aImage);
   double  getX() const { return mX; }
   bool    hasPixel(Vertex const &aHit) const;
+  // False if a ray from aStart in aDirection surely passes the object, going on straight with csCullSlope tolerance.
+  bool    mayCross(Vertex const &aStart, Vector const &aDirection) const;
+  RungeKuttaRayBending::Window getWindow() const { return { mX, mMinY, mMaxY, mMinZ, mMaxZ }; }
+  bool    isCentered() const { return mMinZ == -mMaxZ; }
   uint8_t getPixel(Vertex const &aHit) const;
+  // Index of the texel of getPixel in rows from the top, getTexelCount outside the billboard.
+  uint32_t getTexelIndex(Vertex const &aHit) const;
+  uint32_t getTexelCount() const { return mImage.get_width() * mImage.get_height(); }
+  // Distance of the hit from the nearest texel boundary, in texels, 0.5 in the texel center.
+  double  getTexelMargin(Vertex const &aHit) const;
+  // Distance of two hits in texels.
+  double  getTexelDistance(Vertex const &aHit1, Vertex const &aHit2) const { return std::hypot(aHit1(1) - aHit2(1), aHit1(2) - aHit2(2)) / mDy; }
 };
 
 
 class Medium final {
 private:
+  RungeKuttaRayBending::Parameters const mParameters;
   Eikonal              mEikonal;
   RungeKuttaRayBending mSolver;
-  Object const&        mObject;
+  Object const&        mObject;   // The billboard, its limits are searched.
+  std::vector<Object const*> mObjects;  // The billboard and the other objects by distance.
+  std::vector<RungeKuttaRayBending::Window> mWindows;  // of the objects a ray may cross, see traceObjects
 
 public:
   Medium(RungeKuttaRayBending::Parameters const& aParameters,
          Eikonal::EarthForm const aEarthForm, double const aEarthRadius, Eikonal::Model const aModel,
-         double const aTempAmbient, double const tempAmbMin, double const tempAmbMax, double const aTempBase, Object const& aObject)
-  : mEikonal(aEarthForm, aEarthRadius, aModel, aTempAmbient, tempAmbMin, tempAmbMax, aTempBase)
-  , mSolver(aParameters, mEikonal)
-  , mObject(aObject) {}
+         double const aTempAmbient, double const tempAmbMin, double const tempAmbMax, double const aTempBase, Object const& aObject,
+         std::vector<Object const*> const& aOthers = {});
+
+  // Same medium with the tolerances and the initial step size multiplied by aLooseFactor, solved in aPrecision.
+  Medium(Medium const& aOther, double const aLooseFactor, RungeKuttaRayBending::Precision const aPrecision);
 
-  Medium(Medium const&) = default;
+  // The solver of the copy refers to its own Eikonal, so each copy can have a different water temperature.
+  Medium(Medium const& aOther) : Medium(aOther, 1.0, aOther.mParameters.mPrecision) {}
   Medium(Medium &&) = delete;
   Medium& operator=(Medium const&) = delete;
   Medium& operator=(Medium &&) = delete;
 
   void setWaterTempAmb(Eikonal::Temperature const aWhich) { mEikonal.setWaterTempAmb(aWhich); }
+  RungeKuttaRayBending::Parameters const& getParameters() const { return mParameters; }
+  Eikonal const& getEikonal() const { return mEikonal; }
+  double getBillboardX() const { return mObject.getX(); }
   uint8_t trace(Ray const& aRay);
+  // With other objects the nearest one hit stops the ray, see traceObjects.
+  uint8_t trace(Ray const& aRay, RungeKuttaRayBending::Result &aHit, uint32_t const aMaxStep = RungeKuttaRayBending::csMaxStep,
+                RungeKuttaRayBending::StepSchedule const * const aHint = nullptr);
+  // These two only see the billboard.
   bool hits(Ray const& aRay);
   RungeKuttaRayBending::Result getHit(Ray const& aRay) { return mSolver.solve4x(aRay.mStart, aRay.mDirection, mObject.getX()); }
+  uint32_t getObjectCount() const { return mObjects.size(); }
+  bool isSymmetric() const;
+  // The object a hit of trace is on, nullptr if the ray missed all of them. With only the billboard always that.
+  Object const* findObject(Vertex const& aHit) const;
+  uint8_t getPixel(Vertex const& aHit) const {
+    auto object = findObject(aHit);
+    return (object != nullptr ? object->getPixel(aHit) : 0u);
+  }
+  // Billboard texels only, getTexelCount for hits on other objects.
+  uint32_t getTexelIndex(Vertex const& aHit) const {
+    return (findObject(aHit) == &mObject ? mObject.getTexelIndex(aHit) : mObject.getTexelCount());
+  }
+  uint32_t getTexelCount() const { return mObject.getTexelCount(); }
+  // 0 for missed rays, so these never pass as safe.
+  double getTexelMargin(Vertex const& aHit) const {
+    auto object = findObject(aHit);
+    return (object != nullptr ? object->getTexelMargin(aHit) : 0.0);
+  }
+  // Infinite unless both hits are on the same object.
+  double getTexelDistance(Vertex const& aHit1, Vertex const& aHit2) const {
+    auto object = findObject(aHit1);
+    return (object != nullptr && object == findObject(aHit2) ? object->getTexelDistance(aHit1, aHit2) : std::numeric_limits<double>::infinity());
+  }
   double getRefract(double const aH) const { return mSolver.getRefract(aH); }
+
+private:
+  RungeKuttaRayBending::Result traceObjects(Ray const& aRay, uint32_t const aMaxStep, RungeKuttaRayBending::StepSchedule const * const aHint);
 };
 
 
 class Image final {
 public:
+  enum class OutputFormat : uint8_t {
+    cIndexed8 = 0u,  // Legacy palette PNG, image content in csColorBlack..255, marks may be burnt in.
+    cGray16   = 1u,  // 16-bit grayscale PNG, texel values scaled by 257.
+    cFloat32  = 2u,  // PFM, texel values / 255, NaN for void.
+    cRaw      = 3u   // Hit buffers of each subsample ray, see writeRaw.
+  };
+
   struct Parameters {
-    uint32_t mRestrictCpu;
-    double   mCamCenter;
-    double   mTilt;
-    double   mBorderFactor;
-    uint32_t mResolutionX;
-    uint32_t mSubsample;
-    double   mMarkIndent;
-    bool     mMarkAcross;
-    bool     mMarkTriple;
+    uint32_t     mRestrictCpu;
+    double       mCamCenter;
+    double       mTilt;
+    double       mBorderFactor;
+    uint32_t     mResolutionX;
+    uint32_t     mSubsample;
+    double       mMarkIndent;
+    bool         mMarkAcross;
+    bool         mMarkTriple;
+    OutputFormat mOutputFormat;
+    uint32_t     mThreadCount;  // 0 means all CPUs except mRestrictCpu
+    bool         mRetainHits;   // Keep the exact hit points to allow reshade
+    double       mTimeBudget;   // seconds for process, 0 means unlimited
+    bool         mProfile;      // Measure the phases of process and the mirage threads
+    bool         mStepHints;    // Start the solver with the step sizes of the previous ray in the row
+    bool         mSymmetry;     // Trace one half of the columns of a left-right symmetric frame, mirror the hits to the other
+    double       mTolLoose;     // Tolerance factor outside the sensitive rows, rays flagged by a check are traced again, 1 means off
+    RungeKuttaRayBending::Precision mPrecision; // Of the rays outside the sensitive rows, flagged ones are traced again in double
+  };
+
+  // Pixels left with the coarse value when the time budget ran out, in output image coordinates.
+  struct Region {
+    int      mX;
+    int      mY;
+    int      mWidth;
+    int      mHeight;
+    uint32_t mCount;
+  };
+
+  // Window of the full frame rendered magnified by processRoi. In pixels the corners are output image coordinates
+  // of the full frame, left and top inclusive, right and bottom exclusive. In degrees they are azimuth and elevation
+  // like the angle limits, and the window covers the pixels nearest to them.
+  struct Roi {
+    bool     mDegrees;
+    double   mX1;
+    double   mY1;
+    double   mX2;
+    double   mY2;
+    uint32_t mZoom;      // output pixels per full frame pixel in each direction
+  };
+
+  // Search results of a frame to bracket the searches of a slightly different next frame.
+  struct LimitHints {
+    std::array<std::vector<double>, 4u> mCriticals;    // Indexed by Eikonal::Temperature
+    std::optional<double>               mMirrorAngle;
   };
 
 private:
@@ -79,14 +186,76 @@ private:
   static constexpr double   csSurfaceDistance     =   1000; // meters
   static constexpr double   csSurfPinholeDist     =      1; // meters
   static constexpr int      csSurfSubsample       =      7;
+  static constexpr uint32_t csSurfThreadShare     =      4u;  // the surface gets this part of the threads beside the mirror height and the mirage
   static constexpr uint8_t  csColorVoid           =      0u;
   static constexpr uint8_t  csColorMirror         =      1u;
   static constexpr uint8_t  csColorBase           =      2u;
   static constexpr uint8_t  csColorBlack          =      3u;
   static constexpr int      csDashCount           =     20;
+  static constexpr int      csLimitWarmWindow     =     16;  // csLimitDelta steps around a previous critical angle
+  static constexpr int      csLimitGapStride      =      2;  // csLimitDelta steps between checks outside the windows
+  static constexpr int      csMirrorWarmWindow    =      8;  // rows around the previous mirror height
+  static constexpr uint32_t csStepBudgetWarmup    =     64u;  // rays traced with full step budget before adapting it
+  static constexpr uint32_t csStepBudgetFactor    =      8u;  // times the mean step count
+  static constexpr uint32_t csStepBudgetMin       =    256u;
+  static constexpr int      csRefineTile          =     32;   // pixels, edge of under-refined regions reported
+  static constexpr int      csTightBand           =      3;   // rows around the limits and the mirror height traced tightly
+  static constexpr double   csLooseTexelMargin    =      0.1; // texels, loose hits closer to a texel boundary are traced again
+  static constexpr uint32_t csBatchRows           =      4u;  // rows per thread traced in one BatchTracer::traceBatch
+  static constexpr double   csLooseDivergence     =      2.0; // texels, loose hits farther from the previous one are traced again
+  static constexpr uint32_t csRawVersion          =      1u;
+  static constexpr uint32_t csRawHeaderSize       =     32u;
+  static constexpr uint32_t csStateVersion        =      1u;
+  static constexpr uint32_t csTileVersion         =      1u;
+  static constexpr uint32_t csTileHeaderSize      =     28u;
+  static constexpr uint32_t csJournalVersion      =      1u;
+  static constexpr uint32_t csJournalHeaderSize   =     88u;
+  static constexpr uint32_t csJournalMarker       = 0x444e4142u;  // "BAND"
+  static constexpr int      csJournalBand         =      4;   // mirage rows per journal record
+  static constexpr uint32_t csWarpChunk           =   4096u;  // pixels taken by a thread at once in warp
+  static constexpr double   csSymmetryTolerance   =   1e-6;  // pixels, allowed offset of the frame center from the pinhole column
+
+  // Scan results of calculateAngleLimits for one temperature, reused in the same frame.
+  struct AngleScan {
+    std::optional<std::vector<double>> mCriticals;
+    std::optional<double>              mDeep;
+    double                             mDeepAngleY;
+  };
+
+  // Values of each subsample ray in image orientation, so row 0 is the top.
+  struct HitBuffer {
+    std::vector<float>    mY;
+    std::vector<float>    mZ;
+    std::vector<uint32_t> mStepCount;
+    std::vector<uint8_t>  mValid;
+  };
 
   uint32_t const  mRestrictCpu;
-  std::vector<uint8_t>         mBuffer;
+  uint32_t const  mThreadCount;
+  bool     const  mRetainHits;
+  double   const  mTimeBudget;
+  bool     const  mProfile;
+  bool     const  mStepHints;
+  bool     const  mSymmetry;
+  double   const  mTolLoose;
+  RungeKuttaRayBending::Precision const mPrecision;
+  Profiler        mProfiler;
+  ThreadPool      mPool;      // Runs the phases of process as a TaskGraph.
+  std::chrono::steady_clock::time_point mDeadline;
+  std::vector<Region>          mUnderRefined;
+  double                       mMirageSeconds;
+  uint64_t                     mMirageRayCount;
+  OutputFormat const           mOutputFormat;
+  std::vector<float>           mBuffer;   // Averaged texel values, NaN for void.
+  std::vector<uint8_t>         mMarks;    // Overlay layer, csColorVoid where there is no mark.
+  HitBuffer                    mHits;     // Only filled for cRaw.
+  std::vector<Vertex>          mRetained; // Only filled for mRetainHits, NaN for missed rays, indexed like mHits.
+  std::vector<uint32_t>        mWarpPixels;  // mBuffer index of each mirage pixel, filled by prepareWarp.
+  std::vector<uint32_t>        mWarpTexels;  // Billboard texel index of each ray of these pixels, the texel count for missed rays.
+  std::vector<uint8_t>         mWarpFrame;   // The frame being warped, followed by a black texel for the missed rays.
+#ifdef SOLVER_STATISTICS
+  std::vector<SolverStatistics> mPixelStatistics; // Of the mirage rays of each output pixel, indexed like mBuffer.
+#endif
   png::image<png::index_pixel> mImage;
   png::palette                 mPalette;
   uint32_t const  mSubSample;
@@ -99,9 +268,9 @@ private:
   Vector   const  mInPlaneY;
   Vertex   const  mPinhole;
   double   const  mBiasSub;
-  double   const  mMarkIndent;
-  bool     const  mMarkAcross;
-  bool     const  mMarkTriple;
+  double          mMarkIndent;
+  bool            mMarkAcross;
+  bool            mMarkTriple;
 
   Medium                &mMedium;
   std::optional<double>  mLimitAngleTop;
@@ -119,25 +288,165 @@ private:
   double                 mPixelSize;
   double                 mBiasZ;
   double                 mBiasY;
+  int                    mMirrorHeight;
+  int                    mMirageBottom;  // Rows traced by calculateMirage, all between the pixel limits unless processing a tile.
+  int                    mMirageTop;
+  int                    mMirageDeep;    // Columns traced by calculateMirage, all between the pixel limits unless processing an ROI.
+  int                    mMirageShallow;
+  int                    mFrameWidth;    // The buffers hold the window at mWindowX, mWindowY of the frame, magnified by mZoom.
+  int                    mFrameHeight;   // All are the image itself except in processRoi.
+  int                    mWindowX;
+  int                    mWindowY;
+  uint32_t               mZoom;
+  bool                   mMirrorColumns; // Set by calculateMirage if the columns right of the center are mirrored.
+  std::array<AngleScan, 4u> mAngleScans;
+  LimitHints             mHints;
+  std::string            mNameJournal;   // Empty for no checkpoints.
+  uint64_t               mJournalHash;
 
 public:
   Image(Parameters const& aPara, Medium &aMedium);
 
-  void process(char const * const aNameSurf, char const * const aNameOut);
+  // Marks go to aNameMarks when not empty, otherwise they are burnt into cIndexed8 output and omitted from the others.
+  void process(char const * const aNameSurf, char const * const aNameOut, char const * const aNameMarks);
+  // No surface rendering if aSurface is empty.
+  void process(png::image<png::gray_pixel> const &aSurface, char const * const aNameOut, char const * const aNameMarks);
+
+  // Distributed rendering in three steps, possibly on other hosts sharing the files. prepareTiles calculates the
+  // limits and the mirror height once into the text file aNameState. processTile renders rows aIndex of aCount
+  // row bands of the mirage into aNameTile, the surface goes into tile 0. The settings must be those of
+  // prepareTiles, and aSurface must be empty if and only if aRenderSurface was false. mergeTiles assembles the
+  // tiles and draws the marks. Without time budget the result equals that of process. Not for cRaw output.
+  // Errors throw std::runtime_error.
+  void prepareTiles(bool const aRenderSurface, char const * const aNameState);
+  void processTile(png::image<png::gray_pixel> const &aSurface, char const * const aNameState, uint32_t const aIndex, uint32_t const aCount, char const * const aNameTile);
+  void mergeTiles(char const * const aNameState, std::vector<std::string> const& aNameTiles, char const * const aNameOut, char const * const aNameMarks);
+
+  // Calculates the limits of the full frame, then traces only the window of aRoi with the full frame geometry
+  // scaled by its zoom, so the cost is proportional to the output size. Writes no marks and no surface, but a JSON
+  // file aNameInfo with the window and the mark rows in full frame pixels. Not for cRaw output or mRetainHits.
+  // Errors throw std::runtime_error.
+  void processRoi(Roi const& aRoi, char const * const aNameOut, char const * const aNameInfo);
+
+  // Calculates the limits of the full frame, then writes the mirage irradiance as if the billboard emitted rays
+  // evenly from its area, as PFM into aNameOut, 1 meaning a white texel seen along straight rays. Writes no surface
+  // and no marks.
+  void processSplat(char const * const aNameOut);
+
+  // Only after process with mRetainHits. Shades the kept hit points with the current billboard of the medium
+  // and redraws the marks using the mark parameters of aPara, the rest of aPara is ignored.
+  void reshade(Parameters const& aPara, char const * const aNameOut, char const * const aNameMarks);
+
+  // Only after process with mRetainHits. Turns the kept hit points into billboard texel indices, so billboard
+  // frames of the same size can be shaded by warp without the medium, at the cost of a gather per ray.
+  void prepareWarp();
+  // Shades the mirage with aFrame, holding the texels of a billboard of the original size in rows from the top,
+  // and writes the image in the output format with the marks of process burnt in if aBurnMarks.
+  void warp(uint8_t const * const aFrame, char const * const aNameOut, bool const aBurnMarks);
+  // Like above, but appends a YUV4MPEG2 frame in full range 4:4:4 with the marks burnt in to aOut, preceded by
+  // the stream header with aFps frames per second if aHeader.
+  void warp(uint8_t const * const aFrame, std::ostream &aOut, bool const aHeader, uint32_t const aFps);
+
+  // Set before process to narrow the searches, falling back to full scans when the brackets fail.
+  void setLimitHints(LimitHints const& aHints) { mHints = aHints; }
+  LimitHints const& getLimitHints() const { return mHints; }
+
+  // Set before process to checkpoint the mirage in bands of rows into the file aName, see writeJournalHeader.
+  // When it already holds a journal of aHash, process takes the geometry from it and traces only the missing
+  // bands, so an interrupted render resumes. A journal of another hash throws std::runtime_error. aHash must
+  // cover everything the texel values depend on. Not for time budget, cRaw output or mRetainHits.
+  void setJournal(std::string const& aName, uint64_t const aHash) { mNameJournal = aName; mJournalHash = aHash; }
+
+  // Wall time and traced rays of calculateMirage in the last process.
+  double   getMirageSeconds()  const { return mMirageSeconds; }
+  uint64_t getMirageRayCount() const { return mMirageRayCount; }
+
+  // Phases of the last process, only filled with mProfile.
+  Profiler const& getProfiler() const { return mProfiler; }
+
+  // Empty unless the time budget ran out before every pixel got fully subsampled.
+  std::vector<Region> const& getUnderRefined() const { return mUnderRefined; }
+
+  // Per pixel solver event counts of the mirage area as aPrefix-<counter>.png 16-bit heatmaps and a JSON
+  // summary aPrefix.json. Only collected when compiled with SOLVER_STATISTICS.
+  void writeStatistics(char const * const aPrefix) const;
 
 private:
   void calculateAngleLimits(Eikonal::Temperature const aWhich);
+  std::vector<double> scanCriticals(Medium &aMedium, std::vector<double> const& aHints);
+  bool scanCriticals(Medium &aMedium, int const aBegin, int const aEnd, bool const aLastHit, std::vector<double> &aCriticals);
+  // aLoad fills aSurface if not empty, concurrently with the limit searches.
+  void processPhases(bool const aRenderSurface, std::function<void()> const& aLoad, png::image<png::gray_pixel> const &aSurface,
+                     char const * const aNameOut, char const * const aNameMarks);
+  // Adds the tasks of calculateGeometry to aGraph, returns the last one.
+  TaskGraph::Id addGeometry(TaskGraph &aGraph, bool const aRenderSurface);
+  void calculateLimits(bool const aRenderSurface);
+  // Angle limits, biases and pixel limits, the critical angles must be scanned before.
+  void calculateGeometry(bool const aRenderSurface);
   void calculateBiases(bool const aRenderSurface);
+  // Sets up a full frame of this size.
+  void resizeBuffers(uint32_t const aWidth, uint32_t const aHeight);
+  // Of mBuffer for pixel coordinates of the frame.
+  size_t getPixelIndex(int const aY, int const aZ) const { return (mFrameWidth - aZ - 1 - mWindowX) + mImage.get_width() * (mFrameHeight - aY - 1 - mWindowY); }
   int calculatePixelLimitY(double const aAngle);
   int calculatePixelLimitZ(double const aAngle);
-  int calculateMirrorHeight();
-  void renderSurface(char const * const aNameSurf);
-  void calculateMirage();
+  // These run on aThreadCount threads of their own.
+  int calculateMirrorHeight(uint32_t const aThreadCount);
+  int calculateMirrorHeight(int const aBegin, int const aEnd, uint32_t const aThreadCount);
+  void renderSurface(png::image<png::gray_pixel> const &aSurface, uint32_t const aThreadCount);
+  void calculateMirage(uint32_t const aThreadCount);
+  void calculateMirageBudgeted(uint32_t const aThreadCount);
+  void calculateMirageJournaled(uint32_t const aThreadCount);
+  void calculateMirageBatched(uint32_t const aThreadCount);
+  void calculateSplat();
+  uint32_t getThreadCount() const;
+  bool isSymmetric() const;
+  // Rows plain enough for BatchTracer: the billboard alone, no loose tracing and no mirrored columns.
+  bool isBatchable() const;
+  int getTracedColumnCount() const;
+  // aRowHits is a buffer of the thread, reused for each row.
+  void traceRow(Medium &aMedium, int const aY, Medium * const aLoose, std::vector<Vertex> &aRowHits);
+  // aSchedule holds the step sizes of the previous valid ray, and gets those of the last valid ray here.
+  // aLoose, with looser tolerances or mixed precision, is used first for rays outside the tight rows if not nullptr.
+  // aPrevious holds the previous hit of the row for its divergence check, and gets the last one here.
+  // aHits receives the hits of the subsample rays if not nullptr, NaN for missed ones, indexed i * mSubSample + j.
+  void tracePixel(Medium &aMedium, int const aY, int const aZ, RungeKuttaRayBending::StepSchedule &aSchedule, Medium * const aLoose = nullptr,
+                  RungeKuttaRayBending::Result * const aPrevious = nullptr, Vertex * const aHits = nullptr);
+  // Of subsample ray aI, aJ of a pixel from the pinhole.
+  Vector getRayDirection(int const aY, int const aZ, uint32_t const aI, uint32_t const aJ) const;
+  // Stores the hit of subsample ray aI, aJ of a pixel for the raw output and the warp mode if kept.
+  void storeHit(int const aY, int const aZ, uint32_t const aI, uint32_t const aJ, RungeKuttaRayBending::Result const& aHit);
+  // Shades a pixel from the hits of its mirror image column, given like in tracePixel.
+  void mirrorPixel(int const aY, int const aZ, Vertex const * const aHits);
+  bool isTightRow(int const aY) const;
+  bool traceCoarse(Medium &aMedium, int const aY, int const aZ, uint32_t const aMaxStep, uint32_t &aStepCount, RungeKuttaRayBending::StepSchedule &aSchedule);
+  void collectUnderRefined(std::vector<uint32_t> const& aOrder, uint32_t const aRefinedCount, int const aWidth);
+  void shadeMirage();
   void drawMarks(int const aMirrorHeight);
+  void write(char const * const aNameOut, char const * const aNameMarks);
+  void shadeWarp(uint8_t const * const aFrame);
+  void writeImage(char const * const aNameOut, bool const aBurnMarks);
+  // Palette index of output pixel aIndex like in png8 output.
+  uint8_t getIndexed(uint32_t const aIndex, bool const aBurnMarks) const;
+  void writeIndexed8(char const * const aName, bool const aBurnMarks);
+  void writeGray16(char const * const aName) const;
+  void writeFloat32(char const * const aName) const;
+  void writeRaw(char const * const aName) const;
+  void writeMarks(char const * const aName) const;
+  void writeState(char const * const aName, bool const aRenderSurface) const;
+  // Returns if the state was prepared with surface rendering.
+  bool readState(char const * const aName);
+  void writeTile(char const * const aName) const;
+  void writeJournalHeader(bool const aRenderSurface) const;
+  void writeRoiInfo(char const * const aName, int const aLeft, int const aTop, int const aRight, int const aBottom, uint32_t const aZoom) const;
+  // Returns false if there is no complete header, true if it matches and the geometry is restored.
+  bool readJournalHeader(bool const aRenderSurface);
+  void readTile(char const * const aName);
 
   static Vector getDirectionInXy(double const aAngle) { return Vector(std::cos(aAngle), std::sin(aAngle), 0.0); }
   static Vector getDirectionInXz(double const aAngle) { return Vector(std::cos(aAngle), 0.0, std::sin(aAngle)); }
   static Vector getDirectionYz(double const aAngleY, double const aAngleZ) { return Vector(std::cos(aAngleY) * std::cos(aAngleZ), std::sin(aAngleY), std::cos(aAngleY) * std::sin(aAngleZ)); }
+  static std::vector<double> const& getLimitGrid();
 };
 
 #endif